@@ -7,6 +7,22 @@
 
 #include "G4ParticleGun.hh"
 #include "G4PhysicalVolumeStore.hh"
+#include "Randomize.hh"
+
+#include "TabulatedDistribution.hh"
+
+#include <memory>
+#include <vector>
+
+struct PrimarySample
+{
+    G4ThreeVector fPosition;
+    G4ThreeVector fDirection;
+    G4double fEnergy;
+    G4double fWeight;
+    // weight without the direction biasing (cone and angular reweighting)
+    G4double fEmissionWeight;
+};
 
 class AdvancedParticleGun : public G4ParticleGun
 {
@@ -15,6 +31,24 @@ public:
     ~AdvancedParticleGun();
 
     virtual void GeneratePrimaryVertex(G4Event *);
+    void GeneratePrimaryVertex(G4Event *, const PrimarySample &sample);
+
+    // Builds the cached source tables. After this call SamplePrimary() only reads
+    // the gun, so it may be called from other threads with their own engine.
+    void PrepareSampling();
+    // True if a setting changed since the last PrepareSampling().
+    inline G4bool IsSamplingChanged() const { return fSamplingChanged; }
+    // Samples a primary starting from the gun defaults given in sample.
+    void SamplePrimary(PrimarySample &sample) const;
+    // Weight per steradian emitted towards direction from the position of a sample:
+    // its weight without the direction biasing times the emission density. The
+    // emission is isotropic with a target volume and follows the angular table if
+    // one is set; otherwise the gun is a pencil beam and the density is 0.
+    G4double GetEmissionDensity(const PrimarySample &sample, const G4ThreeVector &direction) const;
+    inline PrimarySample GetDefaultSample() const
+    {
+        return PrimarySample{GetParticlePosition(), GetParticleMomentumDirection(), GetParticleEnergy(), 1., 1.};
+    }
 
     inline void SetSourceVolume(G4VPhysicalVolume *sourceVol)
     {
@@ -49,10 +83,59 @@ public:
     inline void SetTargetVolumeMargin(G4double margin) { fTargetVolumeMargin = margin; }
     inline G4VPhysicalVolume *GetTargetVolume() const { return fTargetVol; }
     inline G4double GetTargetVolumeMargin() const { return fTargetVolumeMargin; }
-    inline void SetNuclideSource(G4String nuclideName) { fNuclideName = nuclideName; }
+    inline void SetNuclideSource(G4String nuclideName)
+    {
+        fNuclideName = nuclideName;
+        fSamplingChanged = true;
+    }
     inline G4String GetNuclideSource() const { return fNuclideName; }
-    inline void SetMinPhotonEnergy(G4double minPhotonEnergy) { fMinPhotonEnergy = minPhotonEnergy; }
+    inline void SetMinPhotonEnergy(G4double minPhotonEnergy)
+    {
+        fMinPhotonEnergy = minPhotonEnergy;
+        fSamplingChanged = true;
+    }
     inline G4double GetMinPhotonEnergy() const { return fMinPhotonEnergy; }
+    inline void SetMaxPhotonEnergy(G4double maxPhotonEnergy)
+    {
+        fMaxPhotonEnergy = maxPhotonEnergy;
+        fSamplingChanged = true;
+    }
+    inline G4double GetMaxPhotonEnergy() const { return fMaxPhotonEnergy; }
+
+    // Lines inside [windowMin, windowMax] keep importance 1, the others get
+    // outsideImportance (0 drops them like the energy cutoffs).
+    void SetEnergyWindow(G4double windowMin, G4double windowMax, G4double outsideImportance = .1);
+    void ClearEnergyWindow();
+    // Importance of the line closest to the energy (within 0.1 %); 0 drops the line.
+    void SetLineImportance(G4double energy, G4double importance);
+    void ClearLineImportances();
+
+    // Energy spectrum file replacing the nuclide lines (an empty name switches back).
+    inline void SetSpectrumFile(G4String fileName)
+    {
+        fSpectrumFileName = fileName;
+        fSamplingChanged = true;
+    }
+    inline G4String GetSpectrumFile() const { return fSpectrumFileName; }
+    // Distribution of the cosine to the gun direction; with a target volume it
+    // reweights the cone sampling instead (an empty name switches back to isotropic).
+    inline void SetAngularDistributionFile(G4String fileName)
+    {
+        fAngularDistributionFileName = fileName;
+        fSamplingChanged = true;
+    }
+    inline G4String GetAngularDistributionFile() const { return fAngularDistributionFileName; }
+    // Energies sampled with equal probability and an unchanged weight, e.g. for a
+    // response matrix; a non-empty grid replaces the spectrum and the nuclide lines.
+    inline void SetEnergyGrid(const std::vector<G4double> &energies)
+    {
+        fEnergyGrid = energies;
+        fSamplingChanged = true;
+    }
+    inline const std::vector<G4double> &GetEnergyGrid() const { return fEnergyGrid; }
+
+    // Point given in the frame of pv, moved up through its mothers to the world frame.
+    static G4ThreeVector ConvertCoordVolume2World(const G4VPhysicalVolume *const pv, const G4ThreeVector pt = G4ThreeVector());
 
 protected:
     G4VPhysicalVolume *fSourceVol;
@@ -60,9 +143,26 @@ protected:
     G4double fTargetVolumeMargin;
     G4String fNuclideName;
     G4double fMinPhotonEnergy;
-    G4ThreeVector ConvertCoordVolume2World(const G4VPhysicalVolume *const pv, const G4ThreeVector pt = G4ThreeVector());
-    G4ThreeVector SamplePointFromVolume(const G4VPhysicalVolume *const pv);
-    G4double GetApexHalfAngleToVolume(const G4ThreeVector pt, const G4VPhysicalVolume *const pv, const G4double margin = 0.);
+    G4double fMaxPhotonEnergy;
+    G4double fWindowMin;
+    G4double fWindowMax;
+    G4double fOutsideImportance;
+    std::vector<std::pair<G4double, G4double>> fLineImportances;
+    G4String fSpectrumFileName;
+    G4String fAngularDistributionFileName;
+    std::vector<G4double> fEnergyGrid;
+    G4ThreeVector SamplePointFromVolume(const G4VPhysicalVolume *const pv) const;
+    G4double GetApexHalfAngleToVolume(const G4ThreeVector pt, const G4VPhysicalVolume *const pv, const G4double margin = 0.) const;
+
+private:
+    G4bool fSamplingChanged;
+    std::vector<G4double> fLineEnergies;
+    std::vector<G4double> fLineWeights;
+    std::unique_ptr<G4RandGeneral> fLineSampler;
+    std::shared_ptr<const TabulatedDistribution> fSpectrum;
+    std::shared_ptr<const TabulatedDistribution> fAngularDistribution;
+
+    G4double GetLineImportance(G4double energy) const;
 };
 
 #endif
@@ -0,0 +1,34 @@
+#ifndef BENCHMARK_HH
+#define BENCHMARK_HH
+
+#include "G4String.hh"
+
+// Thread-scaling benchmark: runs this executable as a child process for
+// several thread counts and event modulos, collects the PROFILE lines of
+// ThreadProfiler and saves the fastest setting to the tuning file read by -t auto.
+class Benchmark
+{
+public:
+    static int Run(const G4String &physName, G4int numberOfEvents);
+
+    // Reads the tuning file; returns false (and leaves the values unchanged) if there is none.
+    static G4bool ReadTuning(G4int &numberOfThreads, G4int &eventModulo);
+
+private:
+    struct Result
+    {
+        G4int fNumberOfThreads;
+        G4int fEventModulo;
+        G4int fNumberOfEvents;
+        G4double fTime;
+        G4double fResidentMemory;
+        G4double fGeneration, fTransport, fOutput;
+        G4int fNumberOfProfiledThreads;
+
+        inline G4double GetEventRate() const { return (fTime > 0.) ? fNumberOfEvents / fTime : 0.; }
+    };
+
+    static G4bool RunChild(const G4String &command, Result &result);
+};
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef CHECKPOINTMANAGER_HH
+#define CHECKPOINTMANAGER_HH
+
+#include "G4Threading.hh"
+#include "G4String.hh"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class G4GenericMessenger;
+
+// A checkpoint file is one CheckpointHeader, then
+//  - for every H1 its number of bins (including under/overflow) as uint32
+//    followed by one CheckpointBin per bin,
+//  - the G4Accumulable<G4double> values, the point-receptor tallies and the
+//    response matrix tally, each as a uint32 count followed by the doubles,
+//  - for every event-loop thread its ID as int32, the rows it added to the EDep
+//    ntuple as uint64, and its engine state as a uint32 count of uint64 words.
+struct CheckpointHeader
+{
+    char fMagic[8];
+    std::uint64_t fRunSeed;
+    std::uint32_t fSeederEnabled;
+    std::uint32_t fGeneration;
+    std::uint64_t fNumberOfEvents;
+    std::uint64_t fNumberOfEventsToBeProcessed;
+    double fElapsedTime; // s, over the interrupted runs
+    std::uint32_t fNumberOfHistograms;
+    std::uint32_t fNumberOfThreads;
+};
+
+struct CheckpointBin
+{
+    double fEntries, fSw, fSw2, fSxw, fSx2w;
+};
+
+static_assert(sizeof(CheckpointHeader) == 56, "CheckpointHeader must be 56 bytes");
+
+constexpr char kCheckpointMagic[8] = {'A', 'D', 'V', 'P', 'G', 'C', 'P', '2'};
+
+// Periodically saves the completed events and the tallies of the current run
+// (H1 histograms, accumulables, point receptors and response matrix), and
+// restores them with -resume, together with the ntuple rows that the
+// interrupted run wrote for the restored events. Event-loop threads copy their own
+// tallies at the next event boundary after a checkpoint is requested; a
+// background thread sums the latest copy of every thread and replaces the
+// file atomically. Configured by /advpg/checkpoint/ commands on the master.
+class CheckpointManager
+{
+public:
+    static CheckpointManager *Instance();
+    ~CheckpointManager();
+
+    inline G4bool IsEnabled() const { return !fFileName.empty() && (fEventInterval > 0 || fTimeInterval > 0.); }
+    inline void SetFileName(G4String fileName) { fFileName = fileName; }
+    inline void SetEventInterval(G4int nEvents) { fEventInterval = nEvents; }
+    inline void SetTimeInterval(G4double minutes) { fTimeInterval = minutes; }
+
+    // Reads a checkpoint to be continued by the next run; returns false if it is unusable.
+    G4bool Restore(const G4String &fileName);
+    // Restored events are skipped: the next run only simulates the remaining ones.
+    inline G4bool IsSkipped(G4int eventID) const { return eventID < fNumberOfSkippedEvents; }
+    // Of the current or last run: events skipped, and events and seconds whose tallies were restored.
+    inline G4int GetNumberOfSkippedEvents() const { return fNumberOfSkippedEvents; }
+    inline std::uint64_t GetNumberOfRestoredEvents() const { return fNumberOfRestoredEvents; }
+    inline G4double GetRestoredTime() const { return fRestoredTime; }
+
+    // Master side
+    void BeginOfRun(G4int numberOfEventsToBeProcessed, G4int numberOfThreads);
+    void EndOfRun();
+    // Sets the ntuple rows of the restored events aside before the output files
+    // named <outputName>_nt_EDep* are reopened, and appends them once they are closed.
+    void PreserveNtuples(const G4String &outputName);
+    void RestoreNtuples();
+    // Event-loop side
+    void BeginOfWorkerRun();
+    inline void CountNtupleRow() { ++fThreadNtupleRows; }
+    void EndOfEvent();
+
+private:
+    CheckpointManager();
+
+    static CheckpointManager *fInstance;
+
+    struct ThreadState
+    {
+        std::uint64_t fNumberOfNtupleRows;
+        std::vector<std::uint64_t> fEngineState;
+    };
+
+    struct Snapshot
+    {
+        std::uint64_t fNumberOfEvents = 0;
+        G4double fElapsedTime = 0.;
+        std::vector<std::vector<CheckpointBin>> fHistograms;
+        std::vector<G4double> fAccumulables;
+        std::vector<G4double> fPointDetectorTallies;
+        std::vector<G4double> fResponseTallies;
+        std::map<G4int, ThreadState> fThreads;
+    };
+
+    G4String fFileName;
+    G4int fEventInterval;
+    G4double fTimeInterval;
+    G4GenericMessenger *fMessenger;
+
+    Snapshot fRestored;
+    G4bool fHasRestored;
+    G4int fNumberOfSkippedEvents;
+    std::uint64_t fNumberOfRestoredEvents;
+    G4double fRestoredTime;
+    std::int64_t fRunStartTime;
+    std::vector<G4String> fPreservedNtuples;
+    std::uint64_t fNumberOfEventsToBeProcessed;
+    G4int fNumberOfThreads;
+
+    std::atomic<std::uint64_t> fEventCounter;
+    std::atomic<G4int> fRequestedEpoch;
+    std::atomic<std::int64_t> fLastRequestTime;
+
+    std::mutex fMutex;
+    std::condition_variable fCondition;
+    std::map<G4int, Snapshot> fSnapshots;
+    std::map<G4int, G4int> fSnapshotEpochs;
+    std::atomic<G4bool> fRunning;
+    std::thread fWriter;
+
+    static G4ThreadLocal G4int fThreadEpoch;
+    static G4ThreadLocal std::uint64_t fThreadEvents;
+    static G4ThreadLocal std::uint64_t fThreadNtupleRows;
+
+    void RequestCheckpoint(std::int64_t lastRequestTime);
+    void TakeSnapshot(G4int epoch);
+    void Write();
+    G4bool WriteFile(const Snapshot &total) const;
+    G4String GetFileName() const;
+
+    static std::int64_t GetTime();
+    static void GetHistograms(std::vector<std::vector<CheckpointBin>> &histograms);
+    static void GetAccumulables(std::vector<G4double> &values);
+    static void Add(Snapshot &sum, const Snapshot &snapshot);
+    static void Add(std::vector<G4double> &sum, const std::vector<G4double> &values);
+
+#ifdef G4MULTITHREADED
+    static G4Mutex CheckpointManagerMutex;
+#endif
+};
+
+#endif
@@ -3,14 +3,19 @@
 
 #include "G4VUserDetectorConstruction.hh"
 
+// The PhaseSpaceSurface shell is only built when phase-space recording is
+// requested on the command line, since its boundaries add steps to every event.
 class DetectorConstruction : public G4VUserDetectorConstruction
 {
 public:
-    DetectorConstruction();
+    DetectorConstruction(G4bool hasPhaseSpaceSurface = false);
     virtual ~DetectorConstruction() override;
 
     virtual G4VPhysicalVolume *Construct() override;
     virtual void ConstructSDandField() override;
+
+private:
+    G4bool fHasPhaseSpaceSurface;
 };
 
 #endif
@@ -0,0 +1,39 @@
+#ifndef ENERGYDEPOSITSD_HH
+#define ENERGYDEPOSITSD_HH
+
+#include "G4VSensitiveDetector.hh"
+
+#include <vector>
+
+class G4LogicalVolume;
+
+// Accumulates the energy deposit and the track-weighted energy deposit per
+// attached volume and copy number into preallocated arrays, without any hits
+// collection. Only the cells touched in an event are reset, and EventAction
+// reads them directly.
+class EnergyDepositSD : public G4VSensitiveDetector
+{
+public:
+    EnergyDepositSD(G4String name, G4int numberOfCopies = 1);
+    virtual ~EnergyDepositSD() override;
+
+    virtual void Initialize(G4HCofThisEvent *) override;
+    virtual G4bool ProcessHits(G4Step *step, G4TouchableHistory *) override;
+
+    // Cells with a deposit in the current event, each index = slot * nCopies + copy number.
+    inline const std::vector<G4int> &GetTouchedCells() const { return fTouchedCells; }
+    inline G4double GetEnergyDeposit(G4int cell) const { return fEnergyDeposits[cell]; }
+    inline G4double GetWeightedEnergyDeposit(G4int cell) const { return fWeightedEnergyDeposits[cell]; }
+    inline G4int GetNumberOfCopies() const { return fNumberOfCopies; }
+
+private:
+    G4int fNumberOfCopies;
+    std::vector<G4LogicalVolume *> fVolumes;
+    std::vector<G4double> fEnergyDeposits;
+    std::vector<G4double> fWeightedEnergyDeposits;
+    std::vector<G4int> fTouchedCells;
+
+    G4int GetCell(const G4Step *step);
+};
+
+#endif
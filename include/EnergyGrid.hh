@@ -0,0 +1,31 @@
+#ifndef ENERGYGRID_HH
+#define ENERGYGRID_HH
+
+#include "G4SystemOfUnits.hh"
+#include "globals.hh"
+
+#include <algorithm>
+#include <cmath>
+
+// Logarithmic energy grid of the tables that are computed with G4EmCalculator at the
+// start of a run: the electron ranges of VarianceReduction and the attenuation
+// coefficients of PointDetectorEstimator.
+namespace EnergyGrid
+{
+    const G4double kMinEnergy = 1. * keV;
+    const G4double kMaxEnergy = 20. * MeV;
+    const G4int kPointsPerDecade = 50;
+    const G4int kNumberOfEnergies = static_cast<G4int>(kPointsPerDecade * std::log10(kMaxEnergy / kMinEnergy)) + 2;
+
+    inline G4double GetEnergy(G4int i)
+    {
+        return kMinEnergy * std::pow(10., static_cast<G4double>(i) / kPointsPerDecade);
+    }
+    // Fractional grid index of an energy; energies below the grid map to 0.
+    inline G4double GetIndex(G4double energy)
+    {
+        return std::log10(std::max(energy, kMinEnergy) / kMinEnergy) * kPointsPerDecade;
+    }
+} // namespace EnergyGrid
+
+#endif
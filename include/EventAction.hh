@@ -3,17 +3,30 @@
 
 #include "G4UserEventAction.hh"
 
+class G4GenericMessenger;
+class RunAction;
+class EnergyDepositSD;
+
 class EventAction : public G4UserEventAction
 {
 public:
-    EventAction();
+    EventAction(RunAction *runAction);
     ~EventAction() override;
 
     virtual void BeginOfEventAction(const G4Event *) override;
     virtual void EndOfEventAction(const G4Event *) override;
 
 private:
-    G4int fHCID;
+    RunAction *fRunAction;
+    EnergyDepositSD *fDetectorSD;
+
+    // Gaussian detector resolution, FWHM(E) = sqrt(a^2 + b^2 E + c^2 E^2) with E in MeV
+    G4double fResolutionA;
+    G4double fResolutionB;
+    G4double fResolutionC;
+    G4GenericMessenger *fMessenger;
+
+    G4double Broaden(G4double eDep) const;
 };
 
 #endif // EVENTACTION_HH
@@ -0,0 +1,59 @@
+#ifndef EVENTSEEDER_HH
+#define EVENTSEEDER_HH
+
+#include "G4Threading.hh"
+
+#include <cstdint>
+
+class G4GenericMessenger;
+
+// Derives the random stream of every event from (run seed, run ID, event ID)
+// through the Philox4x32 counter-based generator, so that any event can be
+// replayed alone and results do not depend on the number of threads.
+class EventSeeder
+{
+public:
+    static EventSeeder *Instance();
+    ~EventSeeder();
+
+    void SetRunSeed(std::uint64_t runSeed);
+    inline std::uint64_t GetRunSeed() const { return fRunSeed; }
+    inline G4bool IsEnabled() const { return fEnabled; }
+    inline void SetEventOffset(G4int offset) { fEventOffset = offset; }
+    inline G4int GetEventOffset() const { return fEventOffset; }
+    inline void SetRunOffset(G4int offset) { fRunOffset = offset; }
+    inline G4int GetRunOffset() const { return fRunOffset; }
+    // Counter word separating the streams of a resumed run from those of the interrupted one.
+    inline void SetGeneration(std::uint32_t generation) { fGeneration = generation; }
+    inline std::uint32_t GetGeneration() const { return fGeneration; }
+    // First event number of the current run, set by the master (e.g. per shard).
+    inline void SetFirstEvent(std::uint64_t firstEvent) { fFirstEvent = firstEvent; }
+
+    // Global number of an event: its ID shifted by the first event and the offset.
+    inline std::uint64_t GetEventNumber(G4int eventID) const
+    {
+        return fFirstEvent + static_cast<std::uint64_t>(fEventOffset) + static_cast<std::uint64_t>(eventID);
+    }
+
+    // Reseeds the engine of the calling thread for the given event.
+    void SeedEvent(G4int runID, G4int eventID) const;
+
+private:
+    EventSeeder();
+
+    static EventSeeder *fInstance;
+
+    G4bool fEnabled;
+    std::uint64_t fRunSeed;
+    G4int fEventOffset;
+    G4int fRunOffset;
+    std::uint64_t fFirstEvent;
+    std::uint32_t fGeneration;
+    G4GenericMessenger *fMessenger;
+
+#ifdef G4MULTITHREADED
+    static G4Mutex EventSeederMutex;
+#endif
+};
+
+#endif
@@ -6,6 +6,10 @@
 #define ICRP07MANAGER_HH
 
 #include "G4Threading.hh"
+#include "G4String.hh"
+
+#include <map>
+#include <vector>
 
 struct DecayData
 {
@@ -29,8 +33,14 @@ public:
 
     RadiationData GetPhotonSource(G4String nuclideName) const;
     RadiationData GetPhotonSourceAllDaughters(G4String nuclideName) const;
+    // Energies of the photon lines of all nuclides, sorted and without duplicates.
+    std::vector<G4double> GetPhotonEnergies() const;
+    // Adds a nuclide to the imported data, or replaces the one of the same name (e.g. a
+    // synthetic nuclide for tests). Not thread-safe: call it before any source is sampled.
+    void AddNuclide(G4String nuclideName, const DecayData &decayData, const RadiationData &radiationData);
     
     void RemoveRadiationDataByMinimumEnergy(RadiationData &originalData, G4double minimumEnergy) const;
+    void RemoveRadiationDataByMaximumEnergy(RadiationData &originalData, G4double maximumEnergy) const;
 
     void PrintNDX() const;
     void PrintRAD() const;
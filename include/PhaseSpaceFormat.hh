@@ -0,0 +1,33 @@
+#ifndef PHASESPACEFORMAT_HH
+#define PHASESPACEFORMAT_HH
+
+#include <cstdint>
+
+// A phase-space file is one PhaseSpaceHeader followed by fNumberOfRecords
+// PhaseSpaceRecord entries. Lengths are in mm and energies in MeV. fHistory is
+// the global event number (modulo 2^32) of the history that produced the
+// particle; consecutive records with the same number are replayed as one event.
+struct PhaseSpaceHeader
+{
+    char fMagic[8];
+    std::uint64_t fNumberOfRecords;
+    std::uint64_t fNumberOfHistories;
+    std::uint64_t fReserved;
+};
+
+struct PhaseSpaceRecord
+{
+    std::int32_t fPDGCode;
+    float fX, fY, fZ;
+    float fU, fV, fW;
+    float fKineticEnergy;
+    float fWeight;
+    std::uint32_t fHistory;
+};
+
+static_assert(sizeof(PhaseSpaceHeader) == 32, "PhaseSpaceHeader must be 32 bytes");
+static_assert(sizeof(PhaseSpaceRecord) == 40, "PhaseSpaceRecord must be 40 bytes");
+
+constexpr char kPhaseSpaceMagic[8] = {'A', 'D', 'V', 'P', 'G', 'P', 'S', '2'};
+
+#endif
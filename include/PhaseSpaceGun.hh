@@ -0,0 +1,41 @@
+#ifndef PHASESPACEGUN_HH
+#define PHASESPACEGUN_HH
+
+#include "G4VPrimaryGenerator.hh"
+#include "G4String.hh"
+
+#include <memory>
+
+class PhaseSpaceReader;
+
+// Replays a recorded phase-space file in place of AdvancedParticleGun.
+// Recorded histories are assigned by global event number, so every history is
+// used by exactly one worker (and shard) per pass regardless of the number of
+// threads, and all its particles are primaries of the same event.
+class PhaseSpaceGun : public G4VPrimaryGenerator
+{
+public:
+    PhaseSpaceGun();
+    virtual ~PhaseSpaceGun() override;
+
+    virtual void GeneratePrimaryVertex(G4Event *) override;
+
+    inline void SetFileName(G4String fileName) { fFileName = fileName; }
+    inline G4String GetFileName() const { return fFileName; }
+    inline G4bool IsActive() const { return !fFileName.empty(); }
+    inline void SetNumberOfRecycles(G4int nRecycles) { fNumberOfRecycles = nRecycles; }
+    inline G4int GetNumberOfRecycles() const { return fNumberOfRecycles; }
+    inline void SetRotation(G4bool rotate) { fRotate = rotate; }
+    inline G4bool GetRotation() const { return fRotate; }
+
+private:
+    G4String fFileName;
+    G4int fNumberOfRecycles;
+    G4bool fRotate;
+
+    G4String fOpenedFileName;
+    G4int fOpenedRunID;
+    std::shared_ptr<const PhaseSpaceReader> fReader;
+};
+
+#endif
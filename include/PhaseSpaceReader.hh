@@ -0,0 +1,78 @@
+#ifndef PHASESPACEREADER_HH
+#define PHASESPACEREADER_HH
+
+#include "G4Threading.hh"
+#include "G4String.hh"
+
+#include "PhaseSpaceFormat.hh"
+
+#include <memory>
+#include <vector>
+
+// Read-only, memory-mapped view of a phase-space file. Readers are shared by
+// all threads: Open() maps each file once and hands out the same instance
+// until the file is replaced; files that cannot be read are not remembered.
+// Native .phsp files and IAEA .IAEAphsp/.IAEAheader pairs are supported.
+class PhaseSpaceReader
+{
+public:
+    static std::shared_ptr<const PhaseSpaceReader> Open(const G4String &fileName);
+    ~PhaseSpaceReader();
+
+    inline G4bool IsValid() const { return fData != nullptr; }
+    inline std::size_t GetNumberOfRecords() const { return fNumberOfRecords; }
+    inline std::uint64_t GetNumberOfHistories() const { return fNumberOfHistories; }
+    // Histories with at least one record; history i holds records [first, end).
+    inline std::size_t GetNumberOfStoredHistories() const { return fHistoryStarts.size(); }
+    inline void GetHistory(std::size_t history, std::size_t &first, std::size_t &end) const
+    {
+        first = fHistoryStarts[history];
+        end = (history + 1 < fHistoryStarts.size()) ? fHistoryStarts[history + 1] : fNumberOfRecords;
+    }
+
+    // IAEA records carry no history number; it is left 0.
+    void GetRecord(std::size_t index, PhaseSpaceRecord &record) const;
+
+private:
+    explicit PhaseSpaceReader(const G4String &fileName);
+
+    enum IAEAVariable { kX, kY, kZ, kU, kV, kW, kWeight, kNumberOfIAEAVariables };
+
+    // device, inode, size and modification time of the mapped file
+    struct FileID
+    {
+        std::uint64_t fDevice, fInode, fSize;
+        std::int64_t fModificationTime;
+
+        inline G4bool operator==(const FileID &other) const
+        {
+            return fDevice == other.fDevice && fInode == other.fInode && fSize == other.fSize && fModificationTime == other.fModificationTime;
+        }
+    };
+
+    FileID fFileID;
+    void *fMapping;
+    std::size_t fMappingSize;
+    const char *fData;
+    std::size_t fNumberOfRecords;
+    std::size_t fRecordLength;
+    std::uint64_t fNumberOfHistories;
+    std::vector<std::size_t> fHistoryStarts;
+
+    G4bool fIsIAEA;
+    G4bool fIAEAStored[kNumberOfIAEAVariables];
+    G4double fIAEAConstants[kNumberOfIAEAVariables];
+
+    static G4String GetDataName(const G4String &fileName);
+    static G4bool GetFileID(const G4String &fileName, FileID &fileID);
+    G4bool Map(const G4String &fileName);
+    G4bool ImportIAEAHeader(const G4String &headerName);
+    void FindHistoryStarts();
+    void GetIAEARecord(std::size_t index, PhaseSpaceRecord &record) const;
+
+#ifdef G4MULTITHREADED
+    static G4Mutex PhaseSpaceReaderMutex;
+#endif
+};
+
+#endif
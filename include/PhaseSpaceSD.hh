@@ -0,0 +1,18 @@
+#ifndef PHASESPACESD_HH
+#define PHASESPACESD_HH
+
+#include "G4VSensitiveDetector.hh"
+
+// Records every particle entering the attached volume from outside into the
+// thread-local PhaseSpaceWriter. Outward crossings are ignored, so a closed
+// shell around the detector records only the inbound phase space.
+class PhaseSpaceSD : public G4VSensitiveDetector
+{
+public:
+    PhaseSpaceSD(G4String name);
+    virtual ~PhaseSpaceSD() override;
+
+    virtual G4bool ProcessHits(G4Step *step, G4TouchableHistory *) override;
+};
+
+#endif
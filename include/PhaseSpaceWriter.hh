@@ -0,0 +1,49 @@
+#ifndef PHASESPACEWRITER_HH
+#define PHASESPACEWRITER_HH
+
+#include "G4Threading.hh"
+#include "G4String.hh"
+
+#include "PhaseSpaceFormat.hh"
+
+#include <fstream>
+#include <vector>
+
+class G4GenericMessenger;
+
+// Thread-local writer of the binary phase-space file. Every event-loop thread
+// writes its own <name>_t<threadID>.phsp, which the master concatenates into
+// <name>.phsp at the end of the run.
+class PhaseSpaceWriter
+{
+public:
+    static PhaseSpaceWriter *Instance();
+    ~PhaseSpaceWriter();
+
+    inline void SetFileName(G4String fileName) { fFileName = fileName; }
+    inline G4String GetFileName() const { return fFileName; }
+    inline G4bool IsOpen() const { return fFile.is_open(); }
+    // Messenger of the /advpg/phsp/ directory on this thread, shared with PhaseSpaceGun.
+    inline G4GenericMessenger *GetMessenger() const { return fMessenger; }
+
+    void Open();
+    void Fill(const PhaseSpaceRecord &record);
+    void Close(G4int numberOfHistories);
+    void Merge(G4int numberOfThreads) const;
+
+private:
+    PhaseSpaceWriter();
+
+    static G4ThreadLocal PhaseSpaceWriter *fInstance;
+
+    G4String fFileName;
+    std::ofstream fFile;
+    std::vector<PhaseSpaceRecord> fBuffer;
+    std::uint64_t fNumberOfRecords;
+    G4GenericMessenger *fMessenger;
+
+    G4String GetThreadFileName(G4int threadID) const;
+    void Flush();
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef PHILOX_HH
+#define PHILOX_HH
+
+#include <array>
+#include <cstdint>
+
+// Philox4x32-10 counter-based generator (Salmon et al., SC'11). Maps a 128-bit
+// counter and a 64-bit key to 128 random bits without any internal state.
+inline std::array<std::uint32_t, 4> Philox4x32(std::array<std::uint32_t, 4> ctr, std::array<std::uint32_t, 2> key)
+{
+    constexpr std::uint32_t kM0 = 0xD2511F53, kM1 = 0xCD9E8D57;
+    constexpr std::uint32_t kW0 = 0x9E3779B9, kW1 = 0xBB67AE85;
+
+    for (int round = 0; round < 10; ++round)
+    {
+        auto p0 = static_cast<std::uint64_t>(kM0) * ctr[0];
+        auto p1 = static_cast<std::uint64_t>(kM1) * ctr[2];
+        ctr = {static_cast<std::uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0], static_cast<std::uint32_t>(p1),
+               static_cast<std::uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1], static_cast<std::uint32_t>(p0)};
+        key[0] += kW0;
+        key[1] += kW1;
+    }
+
+    return ctr;
+}
+
+#endif
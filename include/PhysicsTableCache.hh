@@ -0,0 +1,34 @@
+#ifndef PHYSICSTABLECACHE_HH
+#define PHYSICSTABLECACHE_HH
+
+#include "G4String.hh"
+
+class G4VUserPhysicsList;
+
+// Stores the physics tables built by the first run in a cache directory and
+// retrieves them in later jobs. Every combination of Geant4 version, physics
+// list, materials and production cut gets its own subdirectory, which is only
+// used once its key file has been written after a successful store.
+class PhysicsTableCache
+{
+public:
+    static PhysicsTableCache *Instance();
+
+    // Called on the master after the geometry (materials) and before the physics is initialized.
+    void Configure(const G4String &cacheDir, const G4String &physicsName, G4VUserPhysicsList *physicsList);
+    // Called on the master after a run; stores the tables once if they were built from scratch.
+    void Store();
+
+private:
+    PhysicsTableCache();
+
+    G4VUserPhysicsList *fPhysicsList;
+    G4String fDirectory;
+    G4String fKey;
+    G4bool fRetrieved;
+    G4bool fStored;
+
+    G4String GetKeyFileName() const { return fDirectory + "/advpg_cache.key"; }
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef POINTDETECTORESTIMATOR_HH
+#define POINTDETECTORESTIMATOR_HH
+
+#include "G4Threading.hh"
+#include "G4ThreeVector.hh"
+
+#include <cstdint>
+#include <vector>
+
+class G4GenericMessenger;
+class G4Material;
+class G4Navigator;
+class G4Step;
+class AdvancedParticleGun;
+struct PrimarySample;
+
+// Next-event (point-detector) estimator of the photon fluence and air kerma at
+// point receptors. At every source emission and every Compton or Rayleigh
+// collision of a photon, the density of being emitted or scattered towards
+// each receptor is attenuated along the straight ray through the geometry and
+// scored with 1/R^2. Configured by /advpg/nee/ commands on the master.
+class PointDetectorEstimator
+{
+public:
+    static PointDetectorEstimator *Instance();
+    ~PointDetectorEstimator();
+
+    inline G4bool IsEnabled() const { return !fReceptors.empty(); }
+
+    // Master side
+    void BeginOfRun();
+    void EndOfRun() const;
+    // Event-loop side
+    void BeginOfWorkerRun();
+    void ScoreEmission(const AdvancedParticleGun &gun, const PrimarySample &sample);
+    void ScoreCollision(const G4Step *step);
+    void EndOfEvent();
+    void EndOfWorkerRun();
+    // Checkpoints: the sums of this thread's completed histories, flattened, and
+    // their addition to the merged tallies on the master.
+    void GetThreadTallies(std::vector<G4double> &tallies) const;
+    G4bool AddTallies(const std::vector<G4double> &tallies);
+
+private:
+    PointDetectorEstimator();
+
+    static PointDetectorEstimator *fInstance;
+
+    struct Tally
+    {
+        std::vector<G4double> fFluence, fKerma;
+        std::vector<G4double> fSumFluence, fSumFluence2, fSumKerma, fSumKerma2;
+        std::uint64_t fNumberOfHistories;
+
+        void Reset(std::size_t numberOfReceptors);
+    };
+
+    std::vector<G4ThreeVector> fReceptors;
+    G4double fExclusionRadius;
+    G4double fActivity;
+    G4GenericMessenger *fMessenger;
+
+    // total attenuation coefficients per material index on a logarithmic energy grid
+    std::vector<std::vector<G4double>> fAttenuationCoefficients;
+    Tally fTotal;
+
+    static G4ThreadLocal Tally *fThreadTally;
+    static G4ThreadLocal G4Navigator *fNavigator;
+
+    void AddReceptor(G4String parameters);
+    void ClearReceptors();
+
+    void BuildAttenuationTables();
+    G4double GetAttenuationCoefficient(G4double energy, const G4Material *material) const;
+    G4double GetTransmission(const G4ThreeVector &start, const G4ThreeVector &end, G4double energy) const;
+    void Score(std::size_t receptor, const G4ThreeVector &position, G4double energy, G4double weightPerSolidAngle);
+
+    // Klein-Nishina angular density per steradian of a free electron.
+    static G4double GetKleinNishinaDensity(G4double energy, G4double cosTheta);
+    // Air kerma per fluence of ICRP 74 (Table A.1), log-log interpolated.
+    static G4double GetAirKermaPerFluence(G4double energy);
+
+#ifdef G4MULTITHREADED
+    static G4Mutex PointDetectorEstimatorMutex;
+#endif
+};
+
+#endif
@@ -2,8 +2,11 @@
 #define PRIMARYGENERATORACTION_HH
 
 #include "G4VUserPrimaryGeneratorAction.hh"
+#include "G4String.hh"
 
+class G4GenericMessenger;
 class AdvancedParticleGun;
+class PhaseSpaceGun;
 
 class PrimaryGeneratorAction : public G4VUserPrimaryGeneratorAction
 {
@@ -15,6 +18,22 @@ public:
 
 private:
     AdvancedParticleGun *fPrimary;
+    PhaseSpaceGun *fPhaseSpace;
+    // run whose volumes and response grid the gun has
+    G4int fRunID;
+    // /advpg/source/ commands, forwarded to the setters of the gun
+    G4GenericMessenger *fMessenger;
+
+    void DefineCommands();
+    void SetNuclideCommand(G4String nuclideName);
+    void SetMinEnergyCommand(G4double energy);
+    void SetMaxEnergyCommand(G4double energy);
+    void SetEnergyWindowCommand(G4String parameters);
+    void ClearEnergyWindowCommand();
+    void SetLineImportanceCommand(G4String parameters);
+    void ClearLineImportancesCommand();
+    void SetSpectrumCommand(G4String fileName);
+    void SetAngularCommand(G4String fileName);
 };
 
 #endif
@@ -0,0 +1,112 @@
+#ifndef PRIMARYPIPELINE_HH
+#define PRIMARYPIPELINE_HH
+
+#include "G4Threading.hh"
+#include "Randomize.hh"
+
+#include "AdvancedParticleGun.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class G4GenericMessenger;
+
+// Pre-sampled primaries of consecutive events in structure-of-arrays layout,
+// with the engine state after each sample, where the transport of its event continues.
+struct PrimaryBlock
+{
+    static constexpr G4int kSize = 256;
+
+    G4double fX[kSize], fY[kSize], fZ[kSize];
+    G4double fU[kSize], fV[kSize], fW[kSize];
+    G4double fEnergy[kSize];
+    G4double fWeight[kSize];
+    G4double fEmissionWeight[kSize];
+    std::vector<unsigned long> fEngineStates[kSize];
+};
+
+// Optional stage that pre-samples primaries on dedicated producer threads.
+// Block n holds the events fFirstEventID + [n, n + 1) * kSize and lives in slot
+// n % depth until all its events are popped. Every primary is sampled right
+// after EventSeeder seeded the producer engine for its event, and the popping
+// worker continues from the engine state after the sample, so every event is
+// the same as without the pipeline. It therefore needs per-event streams (-s).
+// Configured by /advpg/pipeline/ commands on the master; disabled by default.
+class PrimaryPipeline
+{
+public:
+    static PrimaryPipeline *Instance();
+    ~PrimaryPipeline();
+
+    inline G4bool IsEnabled() const { return fNumberOfProducers > 0; }
+    inline G4bool IsRunning() const { return fRunning.load(std::memory_order_acquire); }
+    inline void SetNumberOfProducers(G4int nProducers) { fNumberOfProducers = nProducers; }
+    inline G4int GetNumberOfProducers() const { return fNumberOfProducers; }
+    inline void SetDepth(G4int depth) { fDepth = depth; }
+    inline G4int GetDepth() const { return fDepth; }
+
+    // Master side: the events [firstEventID, firstEventID + numberOfEvents) of the run are pre-sampled.
+    void Start(G4int runID, G4int firstEventID, G4int numberOfEvents);
+    void Stop();
+    // Worker side: the first call of a run prepares the gun of the calling worker,
+    // after its commands of the run were applied, and the producers sample it from
+    // then on. Sets the engine of the calling thread to continue the event; false
+    // if the event is not pre-sampled or the pipeline has stopped.
+    G4bool Pop(AdvancedParticleGun *gun, G4int eventID, PrimarySample &sample);
+
+private:
+    PrimaryPipeline();
+
+    static PrimaryPipeline *fInstance;
+
+    struct Slot
+    {
+        PrimaryBlock fBlock;
+        // block the slot may be filled with next, and block it holds once filled
+        std::atomic<std::int64_t> fFreeFor;
+        std::atomic<std::int64_t> fReadyBlock;
+        std::atomic<G4int> fNumberOfPopped;
+    };
+
+    G4int fNumberOfProducers;
+    G4int fDepth;
+    G4GenericMessenger *fMessenger;
+
+    G4int fRunID;
+    G4int fFirstEventID;
+    G4int fNumberOfEvents;
+    std::int64_t fNumberOfBlocks;
+    std::unique_ptr<Slot[]> fSlots;
+    alignas(64) std::atomic<std::int64_t> fNextBlock;
+    std::atomic<AdvancedParticleGun *> fGun;
+    PrimarySample fDefaultSample;
+    std::vector<std::unique_ptr<CLHEP::HepRandomEngine>> fEngines;
+    std::vector<std::thread> fProducers;
+    std::atomic<G4bool> fRunning;
+
+    // a worker waiting for its block first spins briefly, then waits for a producer to signal one
+    std::mutex fMutex;
+    std::condition_variable fFilled;
+    std::atomic<G4int> fNumberOfWaiting;
+    std::atomic<std::uint64_t> fStalls;
+
+    inline G4int GetNumberOfEvents(std::int64_t block) const
+    {
+        return static_cast<G4int>(std::min<std::int64_t>(PrimaryBlock::kSize, fNumberOfEvents - block * PrimaryBlock::kSize));
+    }
+    void Prepare(AdvancedParticleGun *gun);
+    void Produce(G4int producerID);
+    void Fill(std::int64_t block, const AdvancedParticleGun *gun);
+
+#ifdef G4MULTITHREADED
+    static G4Mutex PrimaryPipelineMutex;
+#endif
+};
+
+#endif
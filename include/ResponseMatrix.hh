@@ -0,0 +1,77 @@
+#ifndef RESPONSEMATRIX_HH
+#define RESPONSEMATRIX_HH
+
+#include "G4Threading.hh"
+#include "G4String.hh"
+
+#include <cstdint>
+#include <vector>
+
+class G4Event;
+class G4GenericMessenger;
+
+// Detector response matrix: the primaries are sampled uniformly over a grid of
+// incident energies and the weighted deposits are tallied per incident energy
+// and deposited-energy bin, so that advpg_fold can fold the matrix with the
+// lines of any ICRP 107 nuclide or mixture without another transport run.
+// Configured by /advpg/response/ commands on the master; the grid may change
+// between runs and is taken by the guns at the start of every run.
+class ResponseMatrix
+{
+public:
+    static ResponseMatrix *Instance();
+    ~ResponseMatrix();
+
+    inline G4bool IsEnabled() const { return !fIncidentEnergies.empty(); }
+    inline const std::vector<G4double> &GetIncidentEnergies() const { return fIncidentEnergies; }
+
+    // Master side
+    void BeginOfRun();
+    void EndOfRun() const;
+    // Event-loop side
+    void BeginOfWorkerRun();
+    // Grid index of the primary energy of the event, -1 if it is not on the grid.
+    G4int GetIncidentIndex(const G4Event *event) const;
+    void Fill(G4int incident, G4double eDep, G4double weight);
+    void EndOfEvent(G4int incident);
+    void EndOfWorkerRun();
+    // Checkpoints: the sums of this thread's completed histories, flattened, and
+    // their addition to the merged tally on the master.
+    void GetThreadTallies(std::vector<G4double> &tallies) const;
+    G4bool AddTallies(const std::vector<G4double> &tallies);
+
+private:
+    ResponseMatrix();
+
+    static ResponseMatrix *fInstance;
+
+    struct Tally
+    {
+        // cell (incident i, deposit bin j) at i * numberOfDepositBins + j
+        std::vector<G4double> fSumWeights, fSumWeights2;
+        std::vector<std::uint64_t> fNumberOfHistories;
+
+        void Reset(std::size_t numberOfIncidentEnergies, std::size_t numberOfDepositBins);
+    };
+
+    std::vector<G4double> fIncidentEnergies;
+    G4int fNumberOfDepositBins;
+    G4double fMaxDeposit;
+    G4String fFileName;
+    G4GenericMessenger *fMessenger;
+
+    Tally fTotal;
+
+    static G4ThreadLocal Tally *fThreadTally;
+
+    void SetGridCommand(G4String parameters);
+    void SetLinesCommand(G4String parameters);
+    void SetDepositCommand(G4String parameters);
+    void Clear();
+
+#ifdef G4MULTITHREADED
+    static G4Mutex ResponseMatrixMutex;
+#endif
+};
+
+#endif
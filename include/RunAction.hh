@@ -2,6 +2,8 @@
 #define RUNACTION_HH
 
 #include "G4UserRunAction.hh"
+#include "G4Accumulable.hh"
+#include "G4Timer.hh"
 
 class RunAction : public G4UserRunAction
 {
@@ -11,6 +13,21 @@ public:
 
     virtual void BeginOfRunAction(const G4Run *) override;
     virtual void EndOfRunAction(const G4Run *) override;
+
+    // Weighted energy deposit of one event, for the relative error and the figure of merit.
+    inline void AddEventTally(G4double tally)
+    {
+        fSumTally += tally;
+        fSumTally2 += tally * tally;
+    }
+
+private:
+    G4Accumulable<G4double> fSumTally;
+    G4Accumulable<G4double> fSumTally2;
+    G4Timer fTimer;
+
+    G4bool IsEventLoopThread() const;
+    void PrintEfficiency(const G4Run *run) const;
 };
 
 #endif
@@ -0,0 +1,58 @@
+#ifndef SAMPLERVALIDATION_HH
+#define SAMPLERVALIDATION_HH
+
+#include "G4String.hh"
+#include "G4ThreeVector.hh"
+
+#include <vector>
+
+class G4VPhysicalVolume;
+
+// Statistical validation of the AdvancedParticleGun samplers: volume positions,
+// cone directions and weights of the target biasing, and nuclide line energies
+// and weights (of synthetic nuclides, and of ICRP 107 ones if the data are
+// found). Every configuration is sampled with a fixed seed and checked by
+// chi-square, Kolmogorov-Smirnov and moment tests against analytic expectations
+// or an independent rejection sampler. Runs without a run manager (advpg_validate).
+class SamplerValidation
+{
+public:
+    // Exit code of a run without failures that skipped configurations (missing ICRP 107 data).
+    static constexpr int kSkipped = 77;
+
+    // 0 if all checks pass, 1 if any fails, kSkipped otherwise.
+    static int Run(G4int numberOfSamples);
+
+private:
+    SamplerValidation(G4int numberOfSamples);
+
+    G4int fNumberOfSamples;
+    G4int fNumberOfChecks;
+    G4int fNumberOfFailures;
+    G4int fNumberOfSkipped;
+
+    void CheckBox();
+    void CheckTubs();
+    void CheckOrb();
+    void CheckAgainstReference();
+    void CheckCone(const G4String &name, const G4ThreeVector &sourcePosition);
+    void CheckTabulated(const G4ThreeVector &targetPosition);
+    // strongestLineImportance applies to the most intense line left after the cutoffs.
+    void CheckLines(const G4String &name, const G4String &nuclide, G4double maxEnergy, G4double windowMin,
+                    G4double windowMax, G4double outsideImportance, G4double strongestLineImportance);
+
+    // Positions sampled by the gun in the local frame of the source volume.
+    std::vector<G4ThreeVector> SamplePositions(G4VPhysicalVolume *pv);
+
+    void Report(const G4String &name, const G4String &test, G4double statistic, G4double pValue);
+    void CheckInside(const G4String &name, G4VPhysicalVolume *pv, const std::vector<G4ThreeVector> &points);
+    void CheckUniform(const G4String &name, const G4String &test, std::vector<G4double> values, G4double min, G4double max);
+    void CheckMean(const G4String &name, const G4String &test, const std::vector<G4double> &values, G4double mean, G4double variance);
+    void CheckSameDistribution(const G4String &name, const G4String &test, std::vector<G4double> values, std::vector<G4double> reference);
+
+    static G4ThreeVector ConvertCoordWorld2Volume(const G4VPhysicalVolume *pv, const G4ThreeVector &ptInWorld);
+    static G4double GetChiSquarePValue(G4double chiSquare, G4int degreesOfFreedom);
+    static G4double GetKolmogorovPValue(G4double distance, G4double effectiveNumber);
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef SHARDMANAGER_HH
+#define SHARDMANAGER_HH
+
+#include "G4String.hh"
+
+#include <cstdint>
+
+// Splits a job over independent processes: shard i of N processes the event
+// range [i * nEvents, (i + 1) * nEvents) of every run and writes its outputs
+// under names suffixed with _shard<i>of<N>.
+class ShardManager
+{
+public:
+    static ShardManager *Instance();
+
+    inline void SetShard(G4int shardIndex, G4int numberOfShards)
+    {
+        fShardIndex = shardIndex;
+        fNumberOfShards = numberOfShards;
+    }
+    inline G4bool IsSharded() const { return fNumberOfShards > 1; }
+    inline G4int GetShardIndex() const { return fShardIndex; }
+    inline G4int GetNumberOfShards() const { return fNumberOfShards; }
+
+    inline std::uint64_t GetFirstEvent(G4int numberOfEventsPerShard) const
+    {
+        return static_cast<std::uint64_t>(fShardIndex) * static_cast<std::uint64_t>(numberOfEventsPerShard);
+    }
+    G4String GetOutputName(const G4String &baseName) const;
+
+private:
+    ShardManager();
+
+    G4int fShardIndex;
+    G4int fNumberOfShards;
+};
+
+#endif
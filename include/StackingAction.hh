@@ -0,0 +1,19 @@
+#ifndef STACKINGACTION_HH
+#define STACKINGACTION_HH
+
+#include "G4UserStackingAction.hh"
+
+// Kills secondary electrons that cannot reach the target volume: their
+// (restricted) range in the least stopping material is shorter than their
+// distance to the sphere enclosing the target. The ranges are
+// tabulated once per run by VarianceReduction.
+class StackingAction : public G4UserStackingAction
+{
+public:
+    StackingAction();
+    virtual ~StackingAction() override;
+
+    virtual G4ClassificationOfNewTrack ClassifyNewTrack(const G4Track *track) override;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef STARTUPPROFILER_HH
+#define STARTUPPROFILER_HH
+
+#include "G4Types.hh"
+
+#include <atomic>
+#include <chrono>
+
+// Measures the time from the start of main() to the first event, split into
+// the run manager initialization and the start of the first run (physics
+// tables, workers). Printed once by the first thread reaching an event.
+class StartupProfiler
+{
+public:
+    static StartupProfiler *Instance();
+
+    void Start();
+    void MarkInitialized();
+    void MarkFirstEvent();
+
+private:
+    StartupProfiler();
+
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point fStartTime;
+    Clock::time_point fInitializedTime;
+    std::atomic<G4bool> fFirstEventSeen;
+};
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef STEPPINGACTION_HH
+#define STEPPINGACTION_HH
+
+#include "G4UserSteppingAction.hh"
+
+// Weighted Russian roulette for tracks moving into a region of lower
+// importance: they survive with the importance ratio p and weight / p.
+class SteppingAction : public G4UserSteppingAction
+{
+public:
+    SteppingAction();
+    virtual ~SteppingAction() override;
+
+    virtual void UserSteppingAction(const G4Step *step) override;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef TABULATEDDISTRIBUTION_HH
+#define TABULATEDDISTRIBUTION_HH
+
+#include "G4Threading.hh"
+#include "G4String.hh"
+
+#include <memory>
+#include <vector>
+
+// Read-only, piecewise-linear probability density loaded from a histogram or
+// point-wise table, compiled into an alias table over the intervals and an
+// inverse CDF inside each interval, so that Sample() costs O(1). Tables are
+// shared by all threads: the Open functions load each file once. A file that
+// fails to load is not cached, so setting it again retries it.
+//
+// File format ('#' starts a comment):
+//   histogram | points       first keyword
+//   unit <unit>              optional, spectra only (default MeV)
+//   <low> <high> <content>   one line per histogram bin, or
+//   <x> <density>            one line per point, linearly interpolated
+class TabulatedDistribution
+{
+public:
+    // Energy spectrum.
+    static std::shared_ptr<const TabulatedDistribution> OpenSpectrum(const G4String &fileName);
+    // Distribution of the cosine of the polar angle to the beam axis, within [-1, 1].
+    static std::shared_ptr<const TabulatedDistribution> OpenAngularDistribution(const G4String &fileName);
+
+    // Uses G4UniformRand(), i.e. the engine of the calling thread.
+    G4double Sample() const;
+    // Normalized density at x (0 outside the table).
+    G4double GetDensity(G4double x) const;
+    inline G4double GetMinimum() const { return fLows.front(); }
+    inline G4double GetMaximum() const { return fHighs.back(); }
+
+private:
+    TabulatedDistribution();
+
+    // interval i spans [fLows[i], fHighs[i]] with a density from fLowDensities[i] to fHighDensities[i]
+    std::vector<G4double> fLows, fHighs;
+    std::vector<G4double> fLowDensities, fHighDensities;
+    std::vector<G4double> fAliasProbabilities;
+    std::vector<G4int> fAliases;
+
+    static std::shared_ptr<const TabulatedDistribution> Open(const G4String &fileName, G4bool isSpectrum);
+    G4bool Import(const G4String &fileName, G4bool isSpectrum);
+    void BuildAliasTable();
+
+#ifdef G4MULTITHREADED
+    static G4Mutex TabulatedDistributionMutex;
+#endif
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef THREADPROFILER_HH
+#define THREADPROFILER_HH
+
+#include "G4Threading.hh"
+
+#include <chrono>
+
+class G4GenericMessenger;
+
+// Optional per-thread split of the event loop time into generation
+// (GeneratePrimaries), transport (tracking) and output (EndOfEventAction).
+// Enabled by /advpg/profile/enable; each thread prints a machine-readable
+// "PROFILE thread ..." line and the master a "PROFILE run ..." line per run.
+class ThreadProfiler
+{
+public:
+    static ThreadProfiler *Instance();
+    ~ThreadProfiler();
+
+    inline G4bool IsEnabled() const { return fEnabled; }
+
+    void BeginOfRun();
+    void StartEvent();
+    void StartTransport();
+    void StartOutput();
+    void EndEvent();
+
+    void PrintThread() const;
+    void PrintRun(G4int numberOfThreads, G4int numberOfEvents, G4double time) const;
+
+    // Resident memory of the process in MB, from /proc/self/status.
+    static G4double GetResidentMemory();
+
+private:
+    ThreadProfiler();
+
+    static ThreadProfiler *fInstance;
+
+    enum Stage
+    {
+        kGeneration,
+        kTransport,
+        kOutput,
+        kNumberOfStages
+    };
+
+    G4bool fEnabled;
+    G4GenericMessenger *fMessenger;
+
+    using Clock = std::chrono::steady_clock;
+    static G4ThreadLocal G4double fStageTimes[kNumberOfStages];
+    static G4ThreadLocal G4int fNumberOfEvents;
+    static G4ThreadLocal Clock::rep fLastMark;
+
+    void Mark(Stage finishedStage);
+
+#ifdef G4MULTITHREADED
+    static G4Mutex ThreadProfilerMutex;
+#endif
+};
+
+#endif
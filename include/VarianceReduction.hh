@@ -0,0 +1,73 @@
+#ifndef VARIANCEREDUCTION_HH
+#define VARIANCEREDUCTION_HH
+
+#include "G4Threading.hh"
+#include "G4ThreeVector.hh"
+
+#include <vector>
+
+class G4GenericMessenger;
+
+// Settings of the optional track killing and Russian roulette around the
+// target volume, shared by the StackingAction and SteppingAction of every
+// thread. Configured by /advpg/vr/ commands on the master.
+class VarianceReduction
+{
+public:
+    static VarianceReduction *Instance();
+    ~VarianceReduction();
+
+    inline G4bool IsEnabled() const { return fKillElectrons || !fImportances.empty(); }
+    inline G4bool IsKillingElectrons() const { return fKillElectrons; }
+    inline G4bool HasImportances() const { return !fImportances.empty(); }
+    // Pulse heights of rouletted histories are biased, so they are not scored with importances.
+    inline G4bool IsScoringPulseHeights() const { return fImportances.empty(); }
+    inline void SetAnalogFOM(G4double fom) { fAnalogFOM = fom; }
+    inline G4double GetAnalogFOM() const { return fAnalogFOM; }
+
+    // Locates the target volume and tabulates the electron ranges; called by
+    // the master before every run.
+    void Prepare();
+
+    // Distance from a point to the sphere enclosing the target.
+    inline G4double GetDistanceToTarget(const G4ThreeVector &position) const
+    {
+        auto distance = (position - fTargetCenter).mag() - fTargetRadius;
+        return (distance > 0.) ? distance : 0.;
+    }
+    // Longest restricted range of an electron of this energy over all materials
+    // (rounded up to the next table energy, DBL_MAX above the table).
+    G4double GetMaxElectronRange(G4double energy) const;
+    // Importance of the smallest importance sphere containing the point (1 outside all of them).
+    G4double GetImportance(const G4ThreeVector &position) const;
+
+private:
+    VarianceReduction();
+
+    static VarianceReduction *fInstance;
+
+    struct ImportanceSphere
+    {
+        G4double fRadius;
+        G4double fImportance;
+    };
+
+    G4String fTargetName;
+    G4bool fKillElectrons;
+    std::vector<ImportanceSphere> fImportances;
+    G4double fAnalogFOM;
+    G4ThreeVector fTargetCenter;
+    G4double fTargetRadius;
+    std::vector<G4double> fMaxElectronRanges;
+    G4GenericMessenger *fMessenger;
+
+    void AddImportance(G4String parameters);
+    void ClearImportances();
+    void BuildElectronRangeTable();
+
+#ifdef G4MULTITHREADED
+    static G4Mutex VarianceReductionMutex;
+#endif
+};
+
+#endif
@@ -29,6 +29,9 @@
 /// \homepage evandde.github.io
 
 #include "G4RunManagerFactory.hh"
+#ifdef G4MULTITHREADED
+#include "G4MTRunManager.hh"
+#endif
 #include "G4PhysListFactory.hh"
 #include "G4UImanager.hh"
 #include "G4VisExecutive.hh"
@@ -37,6 +40,15 @@
 
 #include "DetectorConstruction.hh"
 #include "ActionInitialization.hh"
+#include "EventSeeder.hh"
+#include "ShardManager.hh"
+#include "CheckpointManager.hh"
+#include "PhysicsTableCache.hh"
+#include "StartupProfiler.hh"
+#include "Benchmark.hh"
+
+#include <cerrno>
+#include <cstdlib>
 
 namespace
 {
@@ -48,51 +60,125 @@ namespace
                << "\n\t[-m] <Set macrofile> default: "
                   "vis.mac"
                   ", inputtype: string"
-               << "\n\t[-t] <Set nThreads> default: 1, inputtype: int, Max: "
+               << "\n\t[-t] <Set nThreads> default: 1, inputtype: int or 'auto' (setting saved by -bench), Max: "
                << G4Threading::G4GetNumberOfCores()
                << "\n\t[-p] <Set physics> default: 'QBBC', inputtype: string"
+               << "\n\t[-s] <Set run seed for per-event random streams> default: time-seeded single stream, inputtype: unsigned int"
+               << "\n\t[-shard] <Process shard i of N of every run> default: 0/1, inputtype: string 'i/N'"
+               << "\n\t[-resume] <Continue the run saved in a checkpoint file> default: none, inputtype: string"
+               << "\n\t[-phsp] <Build the phase-space surface and record into <name>.phsp> default: none, inputtype: string"
+               << "\n\t[-c] <Set physics table cache directory> default: none (tables are always built), inputtype: string"
+               << "\n\t[-bench] <Benchmark thread counts and event modulos with n events each> default: none, inputtype: int"
                << G4endl;
     }
 } // namespace
 
 int main(int argc, char **argv)
 {
+    StartupProfiler::Instance()->Start();
+
     // Default setting for main() arguments
     G4String macroFilePath;
     G4int nThreads = 1;
     G4String physName;
+    G4bool hasRunSeed = false;
+    std::uint64_t runSeed = 0;
+    G4int shardIndex = 0;
+    G4int nShards = 1;
+    G4String resumeFilePath;
+    G4String phaseSpaceName;
+    G4String cacheDirPath;
+    G4int nBenchmarkEvents = 0;
+    G4int eventModulo = 0;
 
     // Parsing main() Arguments
     for (G4int i = 1; i < argc; i = i + 2)
     {
+        // every option takes one value
+        if (i + 1 >= argc)
+        {
+            PrintUsage();
+            return 1;
+        }
+
         if (G4String(argv[i]) == "-m")
             macroFilePath = argv[i + 1];
         else if (G4String(argv[i]) == "-t")
-            nThreads = G4UIcommand::ConvertToInt(argv[i + 1]);
+        {
+            if (G4String(argv[i + 1]) != "auto")
+                nThreads = G4UIcommand::ConvertToInt(argv[i + 1]);
+            else if (!Benchmark::ReadTuning(nThreads, eventModulo))
+            {
+                G4cout << "WARNING: No tuning file; run with -bench first. All cores are used.\n\n";
+                nThreads = G4Threading::G4GetNumberOfCores();
+            }
+        }
         else if (G4String(argv[i]) == "-p")
             physName = argv[i + 1];
+        else if (G4String(argv[i]) == "-s")
+        {
+            char *end = nullptr;
+            errno = 0;
+            runSeed = std::strtoull(argv[i + 1], &end, 10);
+            if (end == argv[i + 1] || *end != '\0' || errno == ERANGE || argv[i + 1][0] == '-')
+            {
+                PrintUsage();
+                return 1;
+            }
+            hasRunSeed = true;
+        }
+        else if (G4String(argv[i]) == "-shard")
+        {
+            G4String shard = argv[i + 1];
+            auto slash = shard.find('/');
+            if (slash != G4String::npos)
+            {
+                shardIndex = G4UIcommand::ConvertToInt(shard.substr(0, slash).c_str());
+                nShards = G4UIcommand::ConvertToInt(shard.substr(slash + 1).c_str());
+            }
+            if (slash == G4String::npos || nShards < 1 || shardIndex < 0 || shardIndex >= nShards)
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if (G4String(argv[i]) == "-resume")
+            resumeFilePath = argv[i + 1];
+        else if (G4String(argv[i]) == "-phsp")
+            phaseSpaceName = argv[i + 1];
+        else if (G4String(argv[i]) == "-c")
+            cacheDirPath = argv[i + 1];
+        else if (G4String(argv[i]) == "-bench")
+            nBenchmarkEvents = G4UIcommand::ConvertToInt(argv[i + 1]);
         else
         {
             PrintUsage();
             return 1;
         }
     }
-    if (argc > 7)
+
+    // Benchmark mode only drives child processes of this executable
+    if (nBenchmarkEvents > 0)
+        return Benchmark::Run(physName, nBenchmarkEvents);
+
+    // Shards share the run seed, so that together they reproduce the unsharded job
+    ShardManager::Instance()->SetShard(shardIndex, nShards);
+    if (nShards > 1 && !hasRunSeed)
     {
-        PrintUsage();
-        return 1;
+        G4cout << "WARNING: -shard without -s; all shards use the run seed 0.\n\n";
+        hasRunSeed = true;
     }
 
     // Set random engine and seed number
     G4Random::setTheEngine(new CLHEP::RanecuEngine);
-    G4Random::setTheSeed(time(nullptr));
+    G4Random::setTheSeed(hasRunSeed ? static_cast<long>(runSeed) : time(nullptr));
 
     // Construct the default run manager
     auto runManager = G4RunManagerFactory::CreateRunManager(
         nThreads == 1 ? G4RunManagerType::Serial : G4RunManagerType::Default, nThreads);
 
     // Set mandatory initialization classes
-    runManager->SetUserInitialization(new DetectorConstruction);
+    runManager->SetUserInitialization(new DetectorConstruction(!phaseSpaceName.empty()));
     G4VModularPhysicsList *phys;
     if (physName.empty())
         phys = new QBBC;
@@ -104,28 +190,65 @@ int main(int argc, char **argv)
     runManager->SetUserInitialization(phys);
     runManager->SetUserInitialization(new ActionInitialization);
 
+    // Derive every event's random stream from (run seed, run ID, event ID)
+    if (hasRunSeed)
+        EventSeeder::Instance()->SetRunSeed(runSeed);
+
+    // Continue a checkpointed run; its random streams take over those of -s
+    if (!resumeFilePath.empty() && !CheckpointManager::Instance()->Restore(resumeFilePath))
+    {
+        delete runManager;
+        return 1;
+    }
+
+#ifdef G4MULTITHREADED
+    // workers are reseeded for every event anyway; skip the per-event master seeds
+    if (EventSeeder::Instance()->IsEnabled())
+        G4MTRunManager::SetSeedOncePerCommunication(2);
+#endif
+
+    // Retrieve the physics tables if a previous job cached them. The key needs the
+    // materials, so the geometry is built first; the flag must be set before
+    // Initialize(), where the MT and tasking managers already build the tables.
+    if (!cacheDirPath.empty())
+    {
+        runManager->InitializeGeometry();
+        PhysicsTableCache::Instance()->Configure(cacheDirPath, physName.empty() ? "QBBC" : physName, phys);
+    }
+
     // Initialize run
     runManager->Initialize();
-
-    // Initialize visualization
-    auto visManager = new G4VisExecutive;
-    visManager->Initialize();
+    StartupProfiler::Instance()->MarkInitialized();
 
     // Get the pointer to the User Interface manager
     auto UImanager = G4UImanager::GetUIpointer();
 
+    // Record the phase space at the surface that -phsp added to the geometry
+    if (!phaseSpaceName.empty())
+        UImanager->ApplyCommand("/advpg/phsp/record " + phaseSpaceName);
+
+#ifdef G4MULTITHREADED
+    // Event batching tuned by -bench (keeping the seeding mode)
+    if (eventModulo > 0 && nThreads > 1)
+        UImanager->ApplyCommand("/run/eventModulo " + std::to_string(eventModulo) + " " +
+                                std::to_string(G4MTRunManager::SeedOncePerCommunication()));
+#endif
+
     // Process macro or start UI session
+    G4VisManager *visManager = nullptr;
     if (macroFilePath.empty())
     {
         // interactive mode (if no macrofile)
         auto ui = new G4UIExecutive(argc, argv);
+        visManager = new G4VisExecutive;
+        visManager->Initialize();
         UImanager->ApplyCommand("/control/execute vis.mac");
         ui->SessionStart();
         delete ui;
     }
     else
     {
-        // batch mode
+        // batch mode, without any vis or UI driver
         G4String command = "/control/execute ";
         UImanager->ApplyCommand(command + macroFilePath);
     }
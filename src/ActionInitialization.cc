@@ -2,6 +2,8 @@
 #include "PrimaryGeneratorAction.hh"
 #include "RunAction.hh"
 #include "EventAction.hh"
+#include "StackingAction.hh"
+#include "SteppingAction.hh"
 
 ActionInitialization::ActionInitialization()
     : G4VUserActionInitialization()
@@ -21,6 +23,9 @@ void ActionInitialization::Build() const
 {
     SetUserAction(new PrimaryGeneratorAction);
 
-    SetUserAction(new RunAction);
-    SetUserAction(new EventAction);
+    auto runAction = new RunAction;
+    SetUserAction(runAction);
+    SetUserAction(new EventAction(runAction));
+    SetUserAction(new StackingAction);
+    SetUserAction(new SteppingAction);
 }
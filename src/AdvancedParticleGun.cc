@@ -6,6 +6,7 @@
 #include "G4PrimaryParticle.hh"
 #include "G4PrimaryVertex.hh"
 #include "G4SystemOfUnits.hh"
+#include "G4PhysicalConstants.hh"
 #include "G4RandomTools.hh"
 #include "G4PhysicalVolumeStore.hh"
 #include "G4TransportationManager.hh"
@@ -15,8 +16,12 @@
 #include "AdvancedParticleGun.hh"
 #include "ICRP07Manager.hh"
 
+#include <algorithm>
+#include <cfloat>
+
 AdvancedParticleGun::AdvancedParticleGun()
-    : fSourceVol(nullptr), fTargetVol(nullptr), fTargetVolumeMargin(0.), fNuclideName(std::string()), fMinPhotonEnergy(0.), G4ParticleGun()
+    : fSourceVol(nullptr), fTargetVol(nullptr), fTargetVolumeMargin(0.), fNuclideName(std::string()), fMinPhotonEnergy(0.), G4ParticleGun(),
+      fMaxPhotonEnergy(DBL_MAX), fWindowMin(0.), fWindowMax(DBL_MAX), fOutsideImportance(1.), fSamplingChanged(true)
 {
 }
 
@@ -24,20 +29,171 @@ AdvancedParticleGun::~AdvancedParticleGun()
 {
 }
 
+void AdvancedParticleGun::SetEnergyWindow(G4double windowMin, G4double windowMax, G4double outsideImportance)
+{
+    if (windowMin >= windowMax || outsideImportance < 0.)
+    {
+        G4cout << "WARNING: Invalid energy window\n\n";
+        return;
+    }
+    fWindowMin = windowMin;
+    fWindowMax = windowMax;
+    fOutsideImportance = outsideImportance;
+    fSamplingChanged = true;
+}
+
+void AdvancedParticleGun::ClearEnergyWindow()
+{
+    fWindowMin = 0.;
+    fWindowMax = DBL_MAX;
+    fOutsideImportance = 1.;
+    fSamplingChanged = true;
+}
+
+void AdvancedParticleGun::SetLineImportance(G4double energy, G4double importance)
+{
+    if (energy <= 0. || importance < 0.)
+    {
+        G4cout << "WARNING: Invalid line importance\n\n";
+        return;
+    }
+    for (auto &lineImportance : fLineImportances)
+    {
+        if (lineImportance.first == energy)
+        {
+            lineImportance.second = importance;
+            fSamplingChanged = true;
+            return;
+        }
+    }
+    fLineImportances.emplace_back(energy, importance);
+    fSamplingChanged = true;
+}
+
+void AdvancedParticleGun::ClearLineImportances()
+{
+    fLineImportances.clear();
+    fSamplingChanged = true;
+}
+
+G4double AdvancedParticleGun::GetLineImportance(G4double energy) const
+{
+    auto importance = (energy < fWindowMin || energy > fWindowMax) ? fOutsideImportance : 1.;
+    for (const auto &lineImportance : fLineImportances)
+    {
+        if (std::abs(lineImportance.first - energy) <= 1e-3 * energy)
+            importance *= lineImportance.second;
+    }
+    return importance;
+}
+
 void AdvancedParticleGun::GeneratePrimaryVertex(G4Event *event)
 {
-    G4double particleWeight = 1.;
+    PrepareSampling();
 
+    auto sample = GetDefaultSample();
+    SamplePrimary(sample);
+    GeneratePrimaryVertex(event, sample);
+}
+
+void AdvancedParticleGun::GeneratePrimaryVertex(G4Event *event, const PrimarySample &sample)
+{
+    // the gun defaults (e.g. the axis of the angular distribution) are kept for the next sample
+    auto defaultSample = GetDefaultSample();
+
+    SetParticlePosition(sample.fPosition);
+    SetParticleMomentumDirection(sample.fDirection);
+    if (fLineSampler || fSpectrum || !fEnergyGrid.empty())
+        SetParticleEnergy(sample.fEnergy);
+
+    G4ParticleGun::GeneratePrimaryVertex(event);
+    event->GetPrimaryVertex()->SetWeight(sample.fWeight);
+
+    SetParticlePosition(defaultSample.fPosition);
+    SetParticleMomentumDirection(defaultSample.fDirection);
+    if (fLineSampler || fSpectrum || !fEnergyGrid.empty())
+        SetParticleEnergy(defaultSample.fEnergy);
+}
+
+void AdvancedParticleGun::PrepareSampling()
+{
+    if (!fSamplingChanged)
+        return;
+    fSamplingChanged = false;
+
+    fLineEnergies.clear();
+    fLineWeights.clear();
+    fLineSampler.reset();
+    fSpectrum = fSpectrumFileName.empty() ? nullptr : TabulatedDistribution::OpenSpectrum(fSpectrumFileName);
+    fAngularDistribution = fAngularDistributionFileName.empty() ? nullptr : TabulatedDistribution::OpenAngularDistribution(fAngularDistributionFileName);
+
+    // a grid or a spectrum replaces the nuclide lines; the particle stays user-defined
+    if (!fEnergyGrid.empty() || fSpectrum)
+    {
+        if (!GetParticleDefinition())
+            SetParticleDefinition(G4Gamma::Definition());
+        return;
+    }
+    if (fNuclideName.empty())
+        return;
+
+    auto icrp107 = ICRP07Manager::Instance();
+    auto photonSource = icrp107->GetPhotonSourceAllDaughters(fNuclideName);
+    icrp107->RemoveRadiationDataByMinimumEnergy(photonSource, fMinPhotonEnergy);
+    icrp107->RemoveRadiationDataByMaximumEnergy(photonSource, fMaxPhotonEnergy);
+
+    // line i is sampled with q_i = y_i * I_i / S and carries the weight y_i / q_i = S / I_i,
+    // which is the total yield for an analog source
+    std::vector<G4double> probabilities;
+    std::vector<G4double> importances;
+    G4double sumBiasedYield = 0.;
+    for (std::size_t i = 0; i < photonSource.fYields.size(); ++i)
+    {
+        auto importance = GetLineImportance(photonSource.fPhotonEnergies[i]);
+        if (importance <= 0.)
+            continue;
+        fLineEnergies.push_back(photonSource.fPhotonEnergies[i]);
+        probabilities.push_back(photonSource.fYields[i] * importance);
+        importances.push_back(importance);
+        sumBiasedYield += photonSource.fYields[i] * importance;
+    }
+    if (probabilities.empty())
+    {
+        G4cout << "WARNING: No photon lines for " << fNuclideName << "\n\n";
+        return;
+    }
+
+    for (const auto &lineImportance : fLineImportances)
+    {
+        auto matched = false;
+        for (const auto &energy : photonSource.fPhotonEnergies)
+            matched |= std::abs(lineImportance.first - energy) <= 1e-3 * energy;
+        if (!matched)
+            G4cout << "WARNING: " << fNuclideName << " has no line at " << lineImportance.first / keV << " keV\n\n";
+    }
+
+    for (const auto &importance : importances)
+        fLineWeights.push_back(sumBiasedYield / importance);
+    fLineSampler.reset(new G4RandGeneral(probabilities.data(), static_cast<G4int>(probabilities.size()), 1));
+
+    SetParticleDefinition(G4Gamma::Definition());
+}
+
+void AdvancedParticleGun::SamplePrimary(PrimarySample &sample) const
+{
     if (fSourceVol)
     {
         auto srcPosInVolume = SamplePointFromVolume(fSourceVol);
-        auto srcPos = ConvertCoordVolume2World(fSourceVol, srcPosInVolume);
-        SetParticlePosition(srcPos);
+        sample.fPosition = ConvertCoordVolume2World(fSourceVol, srcPosInVolume);
     }
 
+    // the gun direction is the axis of the angular distribution
+    auto beamAxis = sample.fDirection.unit();
+    sample.fEmissionWeight = sample.fWeight;
+
     if (fTargetVol)
     {
-        auto srcPos = GetParticlePosition();
+        auto srcPos = sample.fPosition;
         auto apexHalfAngle = GetApexHalfAngleToVolume(srcPos, fTargetVol, fTargetVolumeMargin);
         auto cosApexHalfAngle = std::cos(apexHalfAngle);
 
@@ -46,7 +202,7 @@ void AdvancedParticleGun::GeneratePrimaryVertex(G4Event *event)
             dir = G4RandomDirection();
         else
         {
-            particleWeight *= (1 - cosApexHalfAngle) / 2.;
+            sample.fWeight *= (1 - cosApexHalfAngle) / 2.;
 
             dir = G4RandomDirection(cosApexHalfAngle);
             auto dirToVolume = ConvertCoordVolume2World(fTargetVol) - srcPos;
@@ -56,33 +212,49 @@ void AdvancedParticleGun::GeneratePrimaryVertex(G4Event *event)
             else
                 dir *= dirToVolume.unit().dot(zUnit);
         }
-        SetParticleMomentumDirection(dir);
-    }
+        sample.fDirection = dir;
 
-    if (!fNuclideName.empty())
+        // ratio of the emission density, p(cos)/2pi per steradian, to the isotropic 1/4pi
+        if (fAngularDistribution)
+            sample.fWeight *= 2. * fAngularDistribution->GetDensity(dir.dot(beamAxis));
+    }
+    else if (fAngularDistribution)
     {
-        auto icrp107 = ICRP07Manager::Instance();
-        auto photonSource = icrp107->GetPhotonSourceAllDaughters(fNuclideName);
-        icrp107->RemoveRadiationDataByMinimumEnergy(photonSource, fMinPhotonEnergy);
-
-        auto totalYield = 0.;
-        for (const auto &yield : photonSource.fYields)
-            totalYield += yield;
-        particleWeight *= totalYield;
-
-        auto sampler = G4RandGeneral(photonSource.fYields.data(), static_cast<G4int>(photonSource.fYields.size()), 1);
-        auto idx = static_cast<G4int>(std::round(sampler.shoot() * photonSource.fYields.size()));
-        auto energy = photonSource.fPhotonEnergies[idx];
-        SetParticleEnergy(energy);
+        auto cosTheta = fAngularDistribution->Sample();
+        auto sinTheta = std::sqrt(1. - cosTheta * cosTheta);
+        auto phi = twopi * G4UniformRand();
+        G4ThreeVector dir(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+        sample.fDirection = dir.rotateUz(beamAxis);
+    }
 
-        SetParticleDefinition(G4Gamma::Definition());
+    if (!fEnergyGrid.empty())
+    {
+        auto idx = std::min(static_cast<std::size_t>(G4UniformRand() * fEnergyGrid.size()), fEnergyGrid.size() - 1);
+        sample.fEnergy = fEnergyGrid[idx];
+    }
+    else if (fLineSampler)
+    {
+        auto idx = static_cast<G4int>(std::round(fLineSampler->shoot(G4Random::getTheEngine()) * fLineEnergies.size()));
+        sample.fWeight *= fLineWeights[idx];
+        sample.fEmissionWeight *= fLineWeights[idx];
+        sample.fEnergy = fLineEnergies[idx];
     }
+    else if (fSpectrum)
+        sample.fEnergy = fSpectrum->Sample();
+}
 
-    G4ParticleGun::GeneratePrimaryVertex(event);
-    event->GetPrimaryVertex()->SetWeight(particleWeight);
+G4double AdvancedParticleGun::GetEmissionDensity(const PrimarySample &sample, const G4ThreeVector &direction) const
+{
+    // a pencil beam has no density towards any other direction
+    if (!fTargetVol && !fAngularDistribution)
+        return 0.;
+
+    auto beamAxis = GetParticleMomentumDirection().unit();
+    auto density = fAngularDistribution ? fAngularDistribution->GetDensity(direction.dot(beamAxis)) / twopi : 1. / (4. * pi);
+    return sample.fEmissionWeight * density;
 }
 
-G4ThreeVector AdvancedParticleGun::SamplePointFromVolume(const G4VPhysicalVolume *const pv)
+G4ThreeVector AdvancedParticleGun::SamplePointFromVolume(const G4VPhysicalVolume *const pv) const
 {
     auto sol = pv->GetLogicalVolume()->GetSolid();
     G4ThreeVector boundMin, boundMax;
@@ -99,7 +271,7 @@ G4ThreeVector AdvancedParticleGun::SamplePointFromVolume(const G4VPhysicalVolume
     return pt;
 }
 
-G4double AdvancedParticleGun::GetApexHalfAngleToVolume(const G4ThreeVector ptInWorld, const G4VPhysicalVolume *const pv, const G4double margin)
+G4double AdvancedParticleGun::GetApexHalfAngleToVolume(const G4ThreeVector ptInWorld, const G4VPhysicalVolume *const pv, const G4double margin) const
 {
     auto sol = pv->GetLogicalVolume()->GetSolid();
     G4ThreeVector boundMin, boundMax;
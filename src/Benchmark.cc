@@ -0,0 +1,186 @@
+#include "G4Threading.hh"
+#include "G4ios.hh"
+
+#include "Benchmark.hh"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include <unistd.h>
+
+namespace
+{
+    const G4String kTuningFileName = "advpg_tuning.txt";
+    const G4String kMacroFileName = "advpg_benchmark.mac";
+
+    // value of "key=value" in a PROFILE line
+    G4double GetValue(const std::string &line, const std::string &key)
+    {
+        auto pos = line.find(" " + key + "=");
+        if (pos == std::string::npos)
+            return 0.;
+        return std::strtod(line.c_str() + pos + key.size() + 2, nullptr);
+    }
+
+    G4String GetExecutablePath()
+    {
+        char path[4096];
+        auto length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+        if (length <= 0)
+            return "./example_advpg";
+        path[length] = '\0';
+        return path;
+    }
+} // namespace
+
+G4bool Benchmark::ReadTuning(G4int &numberOfThreads, G4int &eventModulo)
+{
+    std::ifstream ifs(kTuningFileName.c_str());
+    if (!ifs.is_open())
+        return false;
+
+    std::string key;
+    G4int value;
+    while (ifs >> key)
+    {
+        if (key[0] == '#')
+        {
+            std::getline(ifs, key);
+            continue;
+        }
+        if (!(ifs >> value))
+            break;
+        if (key == "threads")
+            numberOfThreads = value;
+        else if (key == "eventModulo")
+            eventModulo = value;
+    }
+    return true;
+}
+
+G4bool Benchmark::RunChild(const G4String &command, Result &result)
+{
+    auto pipe = popen(command.c_str(), "r");
+    if (!pipe)
+        return false;
+
+    result.fNumberOfEvents = 0;
+    result.fTime = result.fResidentMemory = 0.;
+    result.fGeneration = result.fTransport = result.fOutput = 0.;
+    result.fNumberOfProfiledThreads = 0;
+
+    char buffer[1024];
+    while (fgets(buffer, sizeof(buffer), pipe))
+    {
+        // worker output may carry a "G4WT<n> > " prefix
+        std::string line(buffer);
+        auto pos = line.find("PROFILE ");
+        if (pos == std::string::npos)
+            continue;
+        line = line.substr(pos);
+
+        if (line.compare(0, 12, "PROFILE run ") == 0)
+        {
+            result.fNumberOfEvents = static_cast<G4int>(GetValue(line, "events"));
+            result.fTime = GetValue(line, "time");
+            result.fResidentMemory = GetValue(line, "rss");
+        }
+        else if (line.compare(0, 15, "PROFILE thread ") == 0 && GetValue(line, "events") > 0.)
+        {
+            result.fGeneration += GetValue(line, "generation");
+            result.fTransport += GetValue(line, "transport");
+            result.fOutput += GetValue(line, "output");
+            ++result.fNumberOfProfiledThreads;
+        }
+    }
+
+    return pclose(pipe) == 0 && result.fTime > 0.;
+}
+
+int Benchmark::Run(const G4String &physName, G4int numberOfEvents)
+{
+    auto executable = GetExecutablePath();
+    auto nCores = G4Threading::G4GetNumberOfCores();
+
+    std::vector<G4int> threadCounts;
+    for (G4int nThreads = 1; nThreads < nCores; nThreads *= 2)
+        threadCounts.push_back(nThreads);
+    threadCounts.push_back(nCores);
+    const std::vector<G4int> eventModulos = {1, 10, 100};
+
+    std::vector<Result> results;
+    for (auto nThreads : threadCounts)
+    {
+        for (auto eventModulo : eventModulos)
+        {
+            // event batching only exists for multi-threaded run managers
+            if (nThreads == 1 && eventModulo != eventModulos.front())
+                continue;
+
+            std::ofstream macro(kMacroFileName.c_str(), std::ios::out | std::ios::trunc);
+            macro << "/control/verbose 0\n/run/verbose 0\n/advpg/profile/enable true\n";
+            if (nThreads > 1)
+                macro << "/run/eventModulo " << eventModulo << " 0\n";
+            macro << "/run/beamOn " << numberOfEvents << "\n";
+            macro.close();
+
+            std::ostringstream command;
+            command << "'" << executable << "' -m " << kMacroFileName << " -t " << nThreads;
+            if (!physName.empty())
+                command << " -p " << physName;
+            command << " 2>/dev/null";
+
+            G4cout << "Benchmark: " << nThreads << " threads, event modulo " << eventModulo << " ..." << G4endl;
+            Result result{nThreads, eventModulo};
+            if (!RunChild(command.str(), result))
+            {
+                G4cerr << "WARNING: Benchmark run with " << nThreads << " threads failed.\n";
+                continue;
+            }
+            results.push_back(result);
+        }
+    }
+    std::remove(kMacroFileName.c_str());
+
+    if (results.empty() || results.front().fNumberOfThreads != 1)
+    {
+        G4cerr << "WARNING: No serial reference run; nothing is tuned.\n";
+        return 1;
+    }
+
+    // efficiency relative to perfect scaling of the serial run; memory per thread beyond the serial one
+    const auto &serial = results.front();
+    G4cout << "\n threads  modulo    events/s  efficiency   gen/thr(s)   trans/thr(s)  out/thr(s)   RSS(MB)  MB/thread\n";
+    const Result *best = &serial;
+    for (const auto &result : results)
+    {
+        auto nProfiled = (result.fNumberOfProfiledThreads > 0) ? result.fNumberOfProfiledThreads : 1;
+        auto memoryPerThread = (result.fNumberOfThreads > 1)
+                                   ? (result.fResidentMemory - serial.fResidentMemory) / (result.fNumberOfThreads - 1)
+                                   : result.fResidentMemory;
+        G4cout << std::setw(8) << result.fNumberOfThreads << std::setw(8) << result.fEventModulo
+               << std::setw(12) << std::setprecision(6) << result.GetEventRate()
+               << std::setw(12) << std::setprecision(3) << result.GetEventRate() / (result.fNumberOfThreads * serial.GetEventRate())
+               << std::setw(13) << result.fGeneration / nProfiled
+               << std::setw(15) << result.fTransport / nProfiled
+               << std::setw(12) << result.fOutput / nProfiled
+               << std::setw(10) << std::setprecision(5) << result.fResidentMemory
+               << std::setw(11) << memoryPerThread << G4endl;
+
+        // prefer fewer threads unless more are clearly (> 2%) faster
+        if (result.GetEventRate() > 1.02 * best->GetEventRate())
+            best = &result;
+    }
+
+    std::ofstream ofs(kTuningFileName.c_str(), std::ios::out | std::ios::trunc);
+    ofs << "# example_advpg -bench " << numberOfEvents << " on a host with " << nCores << " cores\n"
+        << "threads " << best->fNumberOfThreads << "\n"
+        << "eventModulo " << best->fEventModulo << "\n";
+    G4cout << "\nBenchmark: " << best->fNumberOfThreads << " threads with event modulo " << best->fEventModulo
+           << " saved to " << kTuningFileName << " for -t auto" << G4endl;
+
+    return 0;
+}
@@ -0,0 +1,651 @@
+#include "G4AccumulableManager.hh"
+#include "G4AutoLock.hh"
+#include "G4GenericMessenger.hh"
+#include "G4ios.hh"
+#include "Randomize.hh"
+#include "g4csv.hh"
+
+#include "CheckpointManager.hh"
+#include "EventSeeder.hh"
+#include "ShardManager.hh"
+#include "PointDetectorEstimator.hh"
+#include "ResponseMatrix.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <dirent.h>
+
+CheckpointManager *CheckpointManager::fInstance = nullptr;
+G4ThreadLocal G4int CheckpointManager::fThreadEpoch = 0;
+G4ThreadLocal std::uint64_t CheckpointManager::fThreadEvents = 0;
+G4ThreadLocal std::uint64_t CheckpointManager::fThreadNtupleRows = 0;
+#ifdef G4MULTITHREADED
+G4Mutex CheckpointManager::CheckpointManagerMutex = G4MUTEX_INITIALIZER;
+#endif
+
+namespace
+{
+    // no checkpoint of this example holds more values in one block
+    constexpr std::uint32_t kMaxNumberOfValues = 1u << 26;
+
+    template <typename T>
+    void WriteValues(std::ofstream &ofs, const std::vector<T> &values)
+    {
+        auto count = static_cast<std::uint32_t>(values.size());
+        ofs.write(reinterpret_cast<const char *>(&count), sizeof(count));
+        ofs.write(reinterpret_cast<const char *>(values.data()), count * sizeof(T));
+    }
+
+    // the count is checked against the rest of the file before anything is allocated
+    template <typename T>
+    G4bool ReadValues(std::ifstream &ifs, std::uint64_t fileSize, std::vector<T> &values)
+    {
+        std::uint32_t count = 0;
+        ifs.read(reinterpret_cast<char *>(&count), sizeof(count));
+        if (!ifs || count > kMaxNumberOfValues || count * sizeof(T) > fileSize - static_cast<std::uint64_t>(ifs.tellg()))
+            return false;
+        values.resize(count);
+        ifs.read(reinterpret_cast<char *>(values.data()), count * sizeof(T));
+        return static_cast<G4bool>(ifs);
+    }
+} // namespace
+
+CheckpointManager *CheckpointManager::Instance()
+{
+    if (fInstance == nullptr)
+    {
+#ifdef G4MULTITHREADED
+        G4MUTEXLOCK(&CheckpointManagerMutex);
+        if (fInstance == nullptr)
+        {
+#endif
+            fInstance = new CheckpointManager;
+#ifdef G4MULTITHREADED
+        }
+        G4MUTEXUNLOCK(&CheckpointManagerMutex);
+#endif
+    }
+
+    return fInstance;
+}
+
+CheckpointManager::CheckpointManager()
+    : fEventInterval(0), fTimeInterval(0.), fHasRestored(false), fNumberOfSkippedEvents(0),
+      fNumberOfRestoredEvents(0), fRestoredTime(0.), fRunStartTime(0),
+      fNumberOfEventsToBeProcessed(0), fNumberOfThreads(1),
+      fEventCounter(0), fRequestedEpoch(0), fLastRequestTime(0), fRunning(false)
+{
+    fMessenger = new G4GenericMessenger(this, "/advpg/checkpoint/", "Run checkpoints");
+
+    auto &fileCmd = fMessenger->DeclareProperty("file", fFileName,
+                                                "Checkpoint file of the current run. An empty name disables checkpoints.");
+    fileCmd.SetStates(G4State_PreInit, G4State_Idle);
+    fileCmd.command->SetToBeBroadcasted(false);
+
+    auto &eventsCmd = fMessenger->DeclareProperty("events", fEventInterval,
+                                                  "Write a checkpoint every n events (0 disables).");
+    eventsCmd.SetParameterName("nEvents", false).SetRange("nEvents>=0");
+    eventsCmd.SetStates(G4State_PreInit, G4State_Idle);
+    eventsCmd.command->SetToBeBroadcasted(false);
+
+    auto &minutesCmd = fMessenger->DeclareProperty("minutes", fTimeInterval,
+                                                   "Write a checkpoint every m minutes (0 disables).");
+    minutesCmd.SetParameterName("minutes", false).SetRange("minutes>=0.");
+    minutesCmd.SetStates(G4State_PreInit, G4State_Idle);
+    minutesCmd.command->SetToBeBroadcasted(false);
+}
+
+CheckpointManager::~CheckpointManager()
+{
+    if (fWriter.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(fMutex);
+            fRunning = false;
+        }
+        fCondition.notify_all();
+        fWriter.join();
+    }
+    delete fMessenger;
+    fInstance = nullptr;
+}
+
+std::int64_t CheckpointManager::GetTime()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+G4String CheckpointManager::GetFileName() const
+{
+    return ShardManager::Instance()->GetOutputName(fFileName) + ".ckpt";
+}
+
+G4bool CheckpointManager::Restore(const G4String &fileName)
+{
+    std::ifstream ifs(fileName.c_str(), std::ios::in | std::ios::binary);
+    if (!ifs.is_open())
+    {
+        G4cerr << "WARNING: There is no " << fileName << ".\n";
+        return false;
+    }
+
+    CheckpointHeader header;
+    ifs.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!ifs || std::memcmp(header.fMagic, kCheckpointMagic, sizeof(header.fMagic)) != 0)
+    {
+        G4cerr << "WARNING: " << fileName << " is not a checkpoint file.\n";
+        return false;
+    }
+
+    ifs.seekg(0, std::ios::end);
+    auto fileSize = static_cast<std::uint64_t>(ifs.tellg());
+    ifs.seekg(sizeof(header));
+
+    // the histograms must be those booked by this build
+    auto analysisManager = G4AnalysisManager::Instance();
+    if (static_cast<G4int>(header.fNumberOfHistograms) != analysisManager->GetNofH1s())
+    {
+        G4cerr << "WARNING: " << fileName << " holds " << header.fNumberOfHistograms << " histograms instead of "
+               << analysisManager->GetNofH1s() << ".\n";
+        return false;
+    }
+    Snapshot restored;
+    restored.fNumberOfEvents = header.fNumberOfEvents;
+    restored.fElapsedTime = header.fElapsedTime;
+    restored.fHistograms.resize(header.fNumberOfHistograms);
+    for (G4int id = 0; id < static_cast<G4int>(restored.fHistograms.size()); ++id)
+    {
+        auto h1 = analysisManager->GetH1(id);
+        if (!ReadValues(ifs, fileSize, restored.fHistograms[id]) || !h1 || restored.fHistograms[id].size() != h1->bins_entries().size())
+        {
+            G4cerr << "WARNING: Histogram " << id << " of " << fileName << " is truncated or does not match the booked one.\n";
+            return false;
+        }
+    }
+
+    auto isComplete = ReadValues(ifs, fileSize, restored.fAccumulables) &&
+                      ReadValues(ifs, fileSize, restored.fPointDetectorTallies) &&
+                      ReadValues(ifs, fileSize, restored.fResponseTallies) &&
+                      header.fNumberOfThreads <= kMaxNumberOfValues;
+    for (std::uint32_t i = 0; isComplete && i < header.fNumberOfThreads; ++i)
+    {
+        std::int32_t threadID = 0;
+        ThreadState state;
+        ifs.read(reinterpret_cast<char *>(&threadID), sizeof(threadID));
+        ifs.read(reinterpret_cast<char *>(&state.fNumberOfNtupleRows), sizeof(state.fNumberOfNtupleRows));
+        isComplete = ifs && ReadValues(ifs, fileSize, state.fEngineState);
+        restored.fThreads[threadID] = std::move(state);
+    }
+    if (!isComplete)
+    {
+        G4cerr << "WARNING: " << fileName << " is truncated.\n";
+        return false;
+    }
+    fRestored = std::move(restored);
+    fHasRestored = true;
+
+    // the remaining events must not reuse the streams of the interrupted run
+    if (header.fSeederEnabled)
+    {
+        auto seeder = EventSeeder::Instance();
+        if (seeder->IsEnabled() && seeder->GetRunSeed() != header.fRunSeed)
+            G4cout << "WARNING: -s is overridden by the run seed " << header.fRunSeed << " of " << fileName << ".\n\n";
+        seeder->SetRunSeed(header.fRunSeed);
+        seeder->SetGeneration(header.fGeneration + 1);
+    }
+    else if (fRestored.fThreads.size() == 1 && fRestored.fThreads.begin()->first == -1)
+    {
+        // a sequential run continues its engine where the checkpoint left it
+        const auto &state = fRestored.fThreads.begin()->second.fEngineState;
+        G4Random::getTheEngine()->get(std::vector<unsigned long>(state.begin(), state.end()));
+    }
+    else if (!fRestored.fThreads.empty())
+    {
+        // workers are reseeded by the master, so the master takes new seeds from the saved engines
+        std::uint64_t hash = 14695981039346656037ull;
+        for (const auto &iter : fRestored.fThreads)
+        {
+            for (auto word : iter.second.fEngineState)
+                hash = (hash ^ word) * 1099511628211ull;
+        }
+        long seeds[3] = {static_cast<long>(hash % 2147483562) + 1, static_cast<long>((hash >> 32) % 2147483398) + 1, 0};
+        G4Random::setTheSeeds(seeds, -1);
+    }
+
+    G4cout << "Checkpoint: " << header.fNumberOfEvents << " of " << header.fNumberOfEventsToBeProcessed
+           << " events restored from " << fileName << G4endl;
+    return true;
+}
+
+void CheckpointManager::BeginOfRun(G4int numberOfEventsToBeProcessed, G4int numberOfThreads)
+{
+    fNumberOfEventsToBeProcessed = numberOfEventsToBeProcessed;
+    fNumberOfThreads = numberOfThreads;
+
+    fNumberOfSkippedEvents = 0;
+    fNumberOfRestoredEvents = fHasRestored ? fRestored.fNumberOfEvents : 0;
+    fRestoredTime = fHasRestored ? fRestored.fElapsedTime : 0.;
+    fRunStartTime = GetTime();
+    if (fHasRestored)
+    {
+        if (fRestored.fNumberOfEvents > static_cast<std::uint64_t>(numberOfEventsToBeProcessed))
+            G4cout << "WARNING: The checkpoint holds more events than this run; only its tallies are added.\n\n";
+        fNumberOfSkippedEvents = static_cast<G4int>(std::min<std::uint64_t>(fRestored.fNumberOfEvents, numberOfEventsToBeProcessed));
+    }
+
+    fEventCounter = 0;
+    fRequestedEpoch = 0;
+    fLastRequestTime = GetTime();
+    fSnapshots.clear();
+    fSnapshotEpochs.clear();
+
+    if (IsEnabled())
+    {
+        fRunning = true;
+        fWriter = std::thread(&CheckpointManager::Write, this);
+    }
+}
+
+void CheckpointManager::EndOfRun()
+{
+    if (fWriter.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(fMutex);
+            fRunning = false;
+        }
+        fCondition.notify_all();
+        fWriter.join();
+
+        // a completed run supersedes its checkpoint
+        std::remove(GetFileName().c_str());
+    }
+
+    if (!fHasRestored)
+        return;
+
+    // the master tallies now hold the merged tallies of this run's events
+    auto analysisManager = G4AnalysisManager::Instance();
+    for (G4int id = 0; id < static_cast<G4int>(fRestored.fHistograms.size()); ++id)
+    {
+        auto h1 = analysisManager->GetH1(id);
+        const auto &bins = fRestored.fHistograms[id];
+        if (!h1 || h1->bins_entries().size() != bins.size())
+        {
+            G4cerr << "WARNING: Histogram " << id << " does not match the checkpoint; its restored tallies are dropped.\n";
+            continue;
+        }
+        for (std::size_t bin = 0; bin < bins.size(); ++bin)
+        {
+            h1->set_bin_content(static_cast<unsigned int>(bin),
+                                h1->bins_entries()[bin] + static_cast<unsigned int>(bins[bin].fEntries),
+                                h1->bins_sum_w()[bin] + bins[bin].fSw,
+                                h1->bins_sum_w2()[bin] + bins[bin].fSw2,
+                                h1->bins_sum_xw()[bin][0] + bins[bin].fSxw,
+                                h1->bins_sum_x2w()[bin][0] + bins[bin].fSx2w);
+        }
+    }
+
+    auto accumulableManager = G4AccumulableManager::Instance();
+    if (static_cast<G4int>(fRestored.fAccumulables.size()) != accumulableManager->GetNofAccumulables())
+        G4cerr << "WARNING: The accumulables do not match the checkpoint; their restored values are dropped.\n";
+    else
+    {
+        for (G4int id = 0; id < accumulableManager->GetNofAccumulables(); ++id)
+        {
+            if (auto accumulable = accumulableManager->GetAccumulable<G4double>(id))
+                *accumulable += fRestored.fAccumulables[id];
+        }
+    }
+
+    if (!PointDetectorEstimator::Instance()->AddTallies(fRestored.fPointDetectorTallies))
+        G4cerr << "WARNING: The point receptors do not match the checkpoint; their restored tallies are dropped.\n";
+    if (!ResponseMatrix::Instance()->AddTallies(fRestored.fResponseTallies))
+        G4cerr << "WARNING: The response grid does not match the checkpoint; its restored tally is dropped.\n";
+
+    // the skipped and restored counts stay readable until the next run
+    fHasRestored = false;
+}
+
+void CheckpointManager::PreserveNtuples(const G4String &outputName)
+{
+    fPreservedNtuples.clear();
+    if (!fHasRestored)
+        return;
+
+    // thread files <outputName>_nt_EDep_t<i>.csv, or <outputName>_nt_EDep.csv of a sequential run
+    auto slash = outputName.rfind('/');
+    auto directory = (slash == G4String::npos) ? G4String(".") : G4String(outputName.substr(0, slash));
+    auto prefix = G4String(outputName.substr(slash == G4String::npos ? 0 : slash + 1)) + "_nt_EDep";
+    auto dir = opendir(directory.c_str());
+    if (!dir)
+        return;
+    std::map<G4String, G4int> fileNames;
+    while (auto entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        if (name.size() < prefix.size() + 4 || name.compare(0, prefix.size(), prefix) != 0 || name.compare(name.size() - 4, 4, ".csv") != 0)
+            continue;
+        auto suffix = name.substr(prefix.size(), name.size() - prefix.size() - 4);
+        G4int threadID = -1;
+        if (!suffix.empty())
+        {
+            char *end = nullptr;
+            if (suffix.compare(0, 2, "_t") != 0 || suffix.size() == 2)
+                continue;
+            threadID = static_cast<G4int>(std::strtol(suffix.c_str() + 2, &end, 10));
+            if (*end != '\0')
+                continue;
+        }
+        fileNames[slash == G4String::npos ? name : directory + "/" + name] = threadID;
+    }
+    closedir(dir);
+
+    std::uint64_t nRows = 0;
+    for (const auto &iter : fileNames)
+    {
+        const auto &fileName = iter.first;
+        auto thread = fRestored.fThreads.find(iter.second);
+        auto nThreadRows = (thread == fRestored.fThreads.end()) ? 0 : thread->second.fNumberOfNtupleRows;
+
+        // rows set aside by an earlier resume that did not complete are all restored, and
+        // the interrupted run's own rows up to the count of its last snapshot
+        auto preservedName = fileName + ".resume";
+        std::vector<std::string> header, rows;
+        std::uint64_t nFileRows = 0;
+        for (const auto &name : {preservedName, fileName})
+        {
+            auto isPreserved = (name == preservedName);
+            std::ifstream ifs(name.c_str());
+            std::string line;
+            std::vector<std::string> fileHeader;
+            while (std::getline(ifs, line))
+            {
+                if (!line.empty() && line[0] == '#')
+                    fileHeader.push_back(line);
+                else if (!line.empty() && (isPreserved || nFileRows++ < nThreadRows))
+                    rows.push_back(line);
+            }
+            if (header.empty())
+                header = fileHeader;
+        }
+        if (nFileRows < nThreadRows)
+            G4cerr << "WARNING: " << fileName << " holds " << nFileRows << " of the " << nThreadRows
+                   << " rows of the restored events; the others were not flushed.\n";
+        if (header.empty() && rows.empty())
+            continue;
+
+        std::ofstream ofs(preservedName.c_str(), std::ios::out | std::ios::trunc);
+        for (const auto &line : header)
+            ofs << line << "\n";
+        for (const auto &row : rows)
+            ofs << row << "\n";
+        fPreservedNtuples.push_back(fileName);
+        nRows += rows.size();
+    }
+
+    if (!fPreservedNtuples.empty())
+        G4cout << "Checkpoint: " << nRows << " ntuple rows of the restored events kept from " << fPreservedNtuples.size() << " files" << G4endl;
+}
+
+void CheckpointManager::RestoreNtuples()
+{
+    for (const auto &fileName : fPreservedNtuples)
+    {
+        auto preservedName = fileName + ".resume";
+        std::ifstream existing(fileName.c_str());
+        if (!existing.is_open())
+        {
+            // no thread of this run wrote this file (e.g. fewer threads): keep the old rows under its name
+            std::rename(preservedName.c_str(), fileName.c_str());
+            continue;
+        }
+        existing.close();
+
+        std::ifstream ifs(preservedName.c_str());
+        std::ofstream ofs(fileName.c_str(), std::ios::out | std::ios::app);
+        std::string line;
+        while (std::getline(ifs, line))
+        {
+            if (!line.empty() && line[0] != '#')
+                ofs << line << "\n";
+        }
+        ifs.close();
+        std::remove(preservedName.c_str());
+    }
+    fPreservedNtuples.clear();
+}
+
+void CheckpointManager::BeginOfWorkerRun()
+{
+    fThreadEpoch = 0;
+    fThreadEvents = 0;
+    fThreadNtupleRows = 0;
+}
+
+void CheckpointManager::EndOfEvent()
+{
+    ++fThreadEvents;
+    if (!fRunning.load(std::memory_order_acquire))
+        return;
+
+    auto nEvents = ++fEventCounter;
+    auto lastRequestTime = fLastRequestTime.load();
+    if (fEventInterval > 0 && nEvents % fEventInterval == 0)
+        RequestCheckpoint(lastRequestTime);
+    else if (fTimeInterval > 0. && GetTime() - lastRequestTime >= fTimeInterval * 60000.)
+        RequestCheckpoint(lastRequestTime);
+
+    auto epoch = fRequestedEpoch.load(std::memory_order_acquire);
+    if (epoch > fThreadEpoch)
+    {
+        fThreadEpoch = epoch;
+        TakeSnapshot(epoch);
+    }
+}
+
+void CheckpointManager::RequestCheckpoint(std::int64_t lastRequestTime)
+{
+    // only one of the threads crossing the interval at the same time requests it
+    if (!fLastRequestTime.compare_exchange_strong(lastRequestTime, GetTime()))
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        ++fRequestedEpoch;
+    }
+    fCondition.notify_all();
+}
+
+void CheckpointManager::GetHistograms(std::vector<std::vector<CheckpointBin>> &histograms)
+{
+    auto analysisManager = G4AnalysisManager::Instance();
+    histograms.resize(analysisManager->GetNofH1s());
+    for (G4int id = 0; id < static_cast<G4int>(histograms.size()); ++id)
+    {
+        auto h1 = analysisManager->GetH1(id);
+        auto &bins = histograms[id];
+        bins.resize(h1->bins_entries().size());
+        for (std::size_t bin = 0; bin < bins.size(); ++bin)
+        {
+            bins[bin].fEntries = h1->bins_entries()[bin];
+            bins[bin].fSw = h1->bins_sum_w()[bin];
+            bins[bin].fSw2 = h1->bins_sum_w2()[bin];
+            bins[bin].fSxw = h1->bins_sum_xw()[bin][0];
+            bins[bin].fSx2w = h1->bins_sum_x2w()[bin][0];
+        }
+    }
+}
+
+void CheckpointManager::GetAccumulables(std::vector<G4double> &values)
+{
+    auto accumulableManager = G4AccumulableManager::Instance();
+    values.resize(accumulableManager->GetNofAccumulables());
+    for (G4int id = 0; id < static_cast<G4int>(values.size()); ++id)
+    {
+        auto accumulable = accumulableManager->GetAccumulable<G4double>(id);
+        values[id] = accumulable ? accumulable->GetValue() : 0.;
+    }
+}
+
+void CheckpointManager::Add(std::vector<G4double> &sum, const std::vector<G4double> &values)
+{
+    if (sum.empty())
+    {
+        sum = values;
+        return;
+    }
+    for (std::size_t i = 0; i < sum.size() && i < values.size(); ++i)
+        sum[i] += values[i];
+}
+
+void CheckpointManager::Add(Snapshot &sum, const Snapshot &snapshot)
+{
+    sum.fNumberOfEvents += snapshot.fNumberOfEvents;
+    if (sum.fHistograms.empty())
+        sum.fHistograms = snapshot.fHistograms;
+    else
+    {
+        for (std::size_t id = 0; id < sum.fHistograms.size() && id < snapshot.fHistograms.size(); ++id)
+        {
+            auto &bins = sum.fHistograms[id];
+            const auto &addedBins = snapshot.fHistograms[id];
+            for (std::size_t bin = 0; bin < bins.size() && bin < addedBins.size(); ++bin)
+            {
+                bins[bin].fEntries += addedBins[bin].fEntries;
+                bins[bin].fSw += addedBins[bin].fSw;
+                bins[bin].fSw2 += addedBins[bin].fSw2;
+                bins[bin].fSxw += addedBins[bin].fSxw;
+                bins[bin].fSx2w += addedBins[bin].fSx2w;
+            }
+        }
+    }
+    Add(sum.fAccumulables, snapshot.fAccumulables);
+    Add(sum.fPointDetectorTallies, snapshot.fPointDetectorTallies);
+    Add(sum.fResponseTallies, snapshot.fResponseTallies);
+}
+
+void CheckpointManager::TakeSnapshot(G4int epoch)
+{
+    // the copy is made outside the lock; the lock only covers the move
+    Snapshot snapshot;
+    snapshot.fNumberOfEvents = fThreadEvents;
+    GetHistograms(snapshot.fHistograms);
+    GetAccumulables(snapshot.fAccumulables);
+    PointDetectorEstimator::Instance()->GetThreadTallies(snapshot.fPointDetectorTallies);
+    ResponseMatrix::Instance()->GetThreadTallies(snapshot.fResponseTallies);
+
+    auto threadID = G4Threading::G4GetThreadId();
+    auto engineState = G4Random::getTheEngine()->put();
+    auto &state = snapshot.fThreads[threadID];
+    state.fNumberOfNtupleRows = fThreadNtupleRows;
+    state.fEngineState.assign(engineState.begin(), engineState.end());
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fSnapshots[threadID] = std::move(snapshot);
+        fSnapshotEpochs[threadID] = epoch;
+    }
+    fCondition.notify_all();
+}
+
+void CheckpointManager::Write()
+{
+    G4int writtenEpoch = 0;
+    std::unique_lock<std::mutex> lock(fMutex);
+    while (true)
+    {
+        fCondition.wait(lock, [&] { return !fRunning || fRequestedEpoch > writtenEpoch; });
+        if (!fRunning)
+            break;
+
+        // wait for every thread, but a thread that stays busy or idle is taken at its last snapshot
+        auto epoch = fRequestedEpoch.load();
+        auto isComplete = [&] {
+            G4int nReady = 0;
+            for (const auto &iter : fSnapshotEpochs)
+                nReady += (iter.second >= epoch) ? 1 : 0;
+            return !fRunning || nReady >= fNumberOfThreads;
+        };
+        fCondition.wait_for(lock, std::chrono::seconds(5), isComplete);
+        if (!fRunning)
+            break;
+
+        // every snapshot holds complete events only, so their sum is a consistent state
+        // the restored rows are kept in the .resume files, so only this run's threads count theirs
+        Snapshot total;
+        if (fHasRestored)
+        {
+            Add(total, fRestored);
+            total.fThreads.clear();
+        }
+        total.fElapsedTime = fRestoredTime + (GetTime() - fRunStartTime) * 1e-3;
+        for (const auto &iter : fSnapshots)
+        {
+            Add(total, iter.second);
+            total.fThreads.insert(iter.second.fThreads.begin(), iter.second.fThreads.end());
+        }
+
+        lock.unlock();
+        if (WriteFile(total))
+            G4cout << "Checkpoint: " << total.fNumberOfEvents << " of " << fNumberOfEventsToBeProcessed
+                   << " events written to " << GetFileName() << G4endl;
+        lock.lock();
+        writtenEpoch = epoch;
+    }
+}
+
+G4bool CheckpointManager::WriteFile(const Snapshot &total) const
+{
+    auto fileName = GetFileName();
+    auto tmpFileName = fileName + ".tmp";
+    std::ofstream ofs(tmpFileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open())
+    {
+        G4cerr << "WARNING: Cannot open " << tmpFileName << ".\n";
+        return false;
+    }
+
+    auto seeder = EventSeeder::Instance();
+    CheckpointHeader header{};
+    std::memcpy(header.fMagic, kCheckpointMagic, sizeof(header.fMagic));
+    header.fRunSeed = seeder->GetRunSeed();
+    header.fSeederEnabled = seeder->IsEnabled() ? 1 : 0;
+    header.fGeneration = seeder->GetGeneration();
+    header.fNumberOfEvents = total.fNumberOfEvents;
+    header.fNumberOfEventsToBeProcessed = fNumberOfEventsToBeProcessed;
+    header.fElapsedTime = total.fElapsedTime;
+    header.fNumberOfHistograms = static_cast<std::uint32_t>(total.fHistograms.size());
+    header.fNumberOfThreads = static_cast<std::uint32_t>(total.fThreads.size());
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    for (const auto &histogram : total.fHistograms)
+        WriteValues(ofs, histogram);
+    WriteValues(ofs, total.fAccumulables);
+    WriteValues(ofs, total.fPointDetectorTallies);
+    WriteValues(ofs, total.fResponseTallies);
+    for (const auto &iter : total.fThreads)
+    {
+        auto threadID = static_cast<std::int32_t>(iter.first);
+        ofs.write(reinterpret_cast<const char *>(&threadID), sizeof(threadID));
+        ofs.write(reinterpret_cast<const char *>(&iter.second.fNumberOfNtupleRows), sizeof(iter.second.fNumberOfNtupleRows));
+        WriteValues(ofs, iter.second.fEngineState);
+    }
+    ofs.close();
+    if (!ofs)
+    {
+        G4cerr << "WARNING: Cannot write " << tmpFileName << ".\n";
+        return false;
+    }
+
+    // rename() replaces the previous checkpoint atomically
+    if (std::rename(tmpFileName.c_str(), fileName.c_str()) != 0)
+    {
+        G4cerr << "WARNING: Cannot replace " << fileName << ".\n";
+        return false;
+    }
+    return true;
+}
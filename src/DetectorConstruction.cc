@@ -2,17 +2,18 @@
 #include "G4NistManager.hh"
 #include "G4Box.hh"
 #include "G4Tubs.hh"
+#include "G4Sphere.hh"
 #include "G4LogicalVolume.hh"
 #include "G4PVPlacement.hh"
 #include "G4VisAttributes.hh"
 #include "G4SDManager.hh"
-#include "G4MultiFunctionalDetector.hh"
-#include "G4PSEnergyDeposit.hh"
 
 #include "DetectorConstruction.hh"
+#include "EnergyDepositSD.hh"
+#include "PhaseSpaceSD.hh"
 
-DetectorConstruction::DetectorConstruction()
-    : G4VUserDetectorConstruction()
+DetectorConstruction::DetectorConstruction(G4bool hasPhaseSpaceSurface)
+    : G4VUserDetectorConstruction(), fHasPhaseSpaceSurface(hasPhaseSpaceSurface)
 {
 }
 
@@ -32,6 +33,7 @@ G4VPhysicalVolume *DetectorConstruction::Construct()
     visWhiteWire->SetForceWireframe();
     auto visCyanSol = new G4VisAttributes(G4Color::Cyan());
     visCyanSol->SetForceSolid();
+    auto visInvisible = new G4VisAttributes(false);
 
     // World
     auto worldSize = 1. * m;
@@ -52,16 +54,31 @@ G4VPhysicalVolume *DetectorConstruction::Construct()
     auto solDetector = new G4Box("Detector", .5 * detectorSize, .5 * detectorSize, .5 * detectorSize);
     auto lvDetector = new G4LogicalVolume(solDetector, matBGO, "Detector");
     lvDetector->SetVisAttributes(visCyanSol);
-    new G4PVPlacement(0, G4ThreeVector(0., 0., .15 * detectorSize), lvDetector, "Detector", lvWorld, false, 0);
+    auto detectorPos = G4ThreeVector(0., 0., .15 * detectorSize);
+    new G4PVPlacement(0, detectorPos, lvDetector, "Detector", lvWorld, false, 0);
+
+    // Phase-space surface (thin air shell enclosing the detector)
+    if (fHasPhaseSpaceSurface)
+    {
+        auto phaseSpaceRadius = 10. * cm;
+        auto solPhaseSpace = new G4Sphere("PhaseSpaceSurface", phaseSpaceRadius - 1. * mm, phaseSpaceRadius, 0. * deg, 360. * deg, 0. * deg, 180. * deg);
+        auto lvPhaseSpace = new G4LogicalVolume(solPhaseSpace, matAir, "PhaseSpaceSurface");
+        lvPhaseSpace->SetVisAttributes(visInvisible);
+        new G4PVPlacement(0, detectorPos, lvPhaseSpace, "PhaseSpaceSurface", lvWorld, false, 0);
+    }
 
     return pvWorld;
 }
 
 void DetectorConstruction::ConstructSDandField()
 {
-    auto mfd = new G4MultiFunctionalDetector("Detector");
-    G4SDManager::GetSDMpointer()->AddNewDetector(mfd);
-    auto psEDep = new G4PSEnergyDeposit("EDep");
-    mfd->RegisterPrimitive(psEDep);
-    SetSensitiveDetector("Detector", mfd);
+    auto detectorSD = new EnergyDepositSD("Detector");
+    G4SDManager::GetSDMpointer()->AddNewDetector(detectorSD);
+    SetSensitiveDetector("Detector", detectorSD);
+
+    if (!fHasPhaseSpaceSurface)
+        return;
+    auto phaseSpaceSD = new PhaseSpaceSD("PhaseSpaceSurface");
+    G4SDManager::GetSDMpointer()->AddNewDetector(phaseSpaceSD);
+    SetSensitiveDetector("PhaseSpaceSurface", phaseSpaceSD);
 }
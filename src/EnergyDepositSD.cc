@@ -0,0 +1,70 @@
+#include "G4Step.hh"
+#include "G4VTouchable.hh"
+
+#include "EnergyDepositSD.hh"
+
+EnergyDepositSD::EnergyDepositSD(G4String name, G4int numberOfCopies)
+    : G4VSensitiveDetector(name), fNumberOfCopies(numberOfCopies)
+{
+    fEnergyDeposits.assign(fNumberOfCopies, 0.);
+    fWeightedEnergyDeposits.assign(fNumberOfCopies, 0.);
+    fTouchedCells.reserve(fNumberOfCopies);
+}
+
+EnergyDepositSD::~EnergyDepositSD()
+{
+}
+
+void EnergyDepositSD::Initialize(G4HCofThisEvent *)
+{
+    for (auto cell : fTouchedCells)
+    {
+        fEnergyDeposits[cell] = 0.;
+        fWeightedEnergyDeposits[cell] = 0.;
+    }
+    fTouchedCells.clear();
+}
+
+G4int EnergyDepositSD::GetCell(const G4Step *step)
+{
+    auto touchable = step->GetPreStepPoint()->GetTouchable();
+    auto volume = touchable->GetVolume()->GetLogicalVolume();
+    auto copyNumber = touchable->GetCopyNumber();
+    if (copyNumber < 0 || copyNumber >= fNumberOfCopies)
+    {
+        G4cerr << "WARNING: Copy number " << copyNumber << " of " << volume->GetName()
+               << " is out of the range of " << GetName() << ".\n";
+        return -1;
+    }
+
+    // a volume gets its slot at its first hit; only then the array grows
+    std::size_t slot = 0;
+    while (slot < fVolumes.size() && fVolumes[slot] != volume)
+        ++slot;
+    if (slot == fVolumes.size())
+    {
+        fVolumes.push_back(volume);
+        fEnergyDeposits.resize(fVolumes.size() * fNumberOfCopies, 0.);
+        fWeightedEnergyDeposits.resize(fVolumes.size() * fNumberOfCopies, 0.);
+    }
+
+    return static_cast<G4int>(slot) * fNumberOfCopies + copyNumber;
+}
+
+G4bool EnergyDepositSD::ProcessHits(G4Step *step, G4TouchableHistory *)
+{
+    auto eDep = step->GetTotalEnergyDeposit();
+    if (eDep <= 0.)
+        return false;
+
+    auto cell = GetCell(step);
+    if (cell < 0)
+        return false;
+
+    if (fEnergyDeposits[cell] == 0.)
+        fTouchedCells.push_back(cell);
+    fEnergyDeposits[cell] += eDep;
+    fWeightedEnergyDeposits[cell] += eDep * step->GetPreStepPoint()->GetWeight();
+
+    return true;
+}
@@ -1,48 +1,111 @@
 #include "G4Event.hh"
+#include "G4GenericMessenger.hh"
+#include "G4PrimaryVertex.hh"
+#include "G4Run.hh"
+#include "G4RunManager.hh"
 #include "G4SDManager.hh"
-#include "G4THitsMap.hh"
+#include "G4SystemOfUnits.hh"
+#include "Randomize.hh"
 #include "g4csv.hh"
 
 #include "EventAction.hh"
+#include "RunAction.hh"
+#include "EnergyDepositSD.hh"
+#include "ShardManager.hh"
+#include "CheckpointManager.hh"
+#include "ThreadProfiler.hh"
+#include "PointDetectorEstimator.hh"
+#include "ResponseMatrix.hh"
+#include "VarianceReduction.hh"
 
-EventAction::EventAction()
-    : G4UserEventAction(), fHCID(-1)
+#include <cmath>
+
+EventAction::EventAction(RunAction *runAction)
+    : G4UserEventAction(), fRunAction(runAction), fDetectorSD(nullptr), fResolutionA(0.), fResolutionB(0.), fResolutionC(0.)
 {
+    fMessenger = new G4GenericMessenger(this, "/advpg/resolution/", "Detector energy resolution");
+    fMessenger->DeclareProperty("a", fResolutionA,
+                                "Constant term a (MeV) of FWHM(E) = sqrt(a^2 + b^2 E + c^2 E^2).");
+    fMessenger->DeclareProperty("b", fResolutionB,
+                                "Statistical term b (MeV^1/2) of FWHM(E) = sqrt(a^2 + b^2 E + c^2 E^2).");
+    fMessenger->DeclareProperty("c", fResolutionC,
+                                "Proportional term c of FWHM(E) = sqrt(a^2 + b^2 E + c^2 E^2).");
 }
 
 EventAction::~EventAction()
 {
+    delete fMessenger;
 }
 
 void EventAction::BeginOfEventAction(const G4Event *)
 {
+    ThreadProfiler::Instance()->StartTransport();
+}
+
+G4double EventAction::Broaden(G4double eDep) const
+{
+    auto e = eDep / MeV;
+    auto fwhm = std::sqrt(fResolutionA * fResolutionA + fResolutionB * fResolutionB * e + fResolutionC * fResolutionC * e * e);
+    if (fwhm <= 0.)
+        return eDep;
+    return G4RandGauss::shoot(e, fwhm / 2.354820045) * MeV;
 }
 
 void EventAction::EndOfEventAction(const G4Event *anEvent)
 {
-    auto HCE = anEvent->GetHCofThisEvent();
-    if (!HCE)
-        return;
+    auto profiler = ThreadProfiler::Instance();
+    profiler->StartOutput();
 
-    if (fHCID == -1)
-        fHCID = G4SDManager::GetSDMpointer()->GetCollectionID("Detector/EDep");
+    auto checkpointManager = CheckpointManager::Instance();
+    if (checkpointManager->IsSkipped(anEvent->GetEventID()))
+    {
+        profiler->EndEvent();
+        return;
+    }
 
-    auto hitsMap = static_cast<G4THitsMap<G4double> *>(HCE->GetHC(fHCID));
+    if (!fDetectorSD)
+        fDetectorSD = static_cast<EnergyDepositSD *>(G4SDManager::GetSDMpointer()->FindSensitiveDetector("Detector"));
 
     auto analysisManager = G4AnalysisManager::Instance();
+    auto responseMatrix = ResponseMatrix::Instance();
+
+    // pulse heights are scored with the history weight, i.e. the source biasing only;
+    // Russian roulette would bias them, so they are not scored then
+    auto scorePulseHeights = VarianceReduction::Instance()->IsScoringPulseHeights();
+    auto incident = scorePulseHeights ? responseMatrix->GetIncidentIndex(anEvent) : -1;
+    auto weight = anEvent->GetPrimaryVertex() ? anEvent->GetPrimaryVertex()->GetWeight() : 1.;
+    auto runID = G4RunManager::GetRunManager()->GetCurrentRun()->GetRunID();
+    auto shardIndex = ShardManager::Instance()->GetShardIndex();
 
-    for (const auto &iter : *(hitsMap->GetMap()))
+    auto eventTally = 0.;
+    for (auto cell : fDetectorSD->GetTouchedCells())
     {
-        auto eDep = *(iter.second);
+        auto eDep = fDetectorSD->GetEnergyDeposit(cell);
         if (eDep > 0.)
         {
-            auto weight = anEvent->GetPrimaryVertex()->GetWeight();
-            analysisManager->FillH1(0, eDep / weight, weight);
+            // the track-weighted deposit stays unbiased under roulette
+            eventTally += fDetectorSD->GetWeightedEnergyDeposit(cell);
+            if (!scorePulseHeights)
+                continue;
+
+            analysisManager->FillH1(0, eDep, weight);
+            analysisManager->FillH1(1, Broaden(eDep), weight);
+            responseMatrix->Fill(incident, eDep, weight);
 
             analysisManager->FillNtupleIColumn(0, anEvent->GetEventID());
-            analysisManager->FillNtupleDColumn(1, eDep / weight);
+            analysisManager->FillNtupleDColumn(1, eDep);
             analysisManager->FillNtupleDColumn(2, weight);
+            analysisManager->FillNtupleIColumn(3, runID);
+            analysisManager->FillNtupleIColumn(4, shardIndex);
             analysisManager->AddNtupleRow();
+            checkpointManager->CountNtupleRow();
         }
     }
+    fRunAction->AddEventTally(eventTally);
+
+    PointDetectorEstimator::Instance()->EndOfEvent();
+    responseMatrix->EndOfEvent(incident);
+
+    checkpointManager->EndOfEvent();
+    profiler->EndEvent();
 }
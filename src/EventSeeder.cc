@@ -0,0 +1,76 @@
+#include "G4GenericMessenger.hh"
+#include "G4UIcommand.hh"
+#include "Randomize.hh"
+
+#include "EventSeeder.hh"
+#include "Philox.hh"
+
+EventSeeder *EventSeeder::fInstance = nullptr;
+#ifdef G4MULTITHREADED
+G4Mutex EventSeeder::EventSeederMutex = G4MUTEX_INITIALIZER;
+#endif
+
+EventSeeder *EventSeeder::Instance()
+{
+    if (fInstance == nullptr)
+    {
+#ifdef G4MULTITHREADED
+        G4MUTEXLOCK(&EventSeederMutex);
+        if (fInstance == nullptr)
+        {
+#endif
+            fInstance = new EventSeeder;
+#ifdef G4MULTITHREADED
+        }
+        G4MUTEXUNLOCK(&EventSeederMutex);
+#endif
+    }
+
+    return fInstance;
+}
+
+EventSeeder::EventSeeder()
+    : fEnabled(false), fRunSeed(0), fEventOffset(0), fRunOffset(0), fFirstEvent(0), fGeneration(0)
+{
+    fMessenger = new G4GenericMessenger(this, "/advpg/random/", "Per-event random streams");
+
+    auto &eventOffsetCmd = fMessenger->DeclareProperty("eventOffset", fEventOffset,
+                                                       "Offset added to the event ID when deriving the event random stream.");
+    eventOffsetCmd.SetParameterName("offset", false).SetRange("offset>=0");
+    eventOffsetCmd.SetStates(G4State_PreInit, G4State_Idle);
+    eventOffsetCmd.command->SetToBeBroadcasted(false);
+
+    auto &runOffsetCmd = fMessenger->DeclareProperty("runOffset", fRunOffset,
+                                                     "Offset added to the run ID when deriving the event random stream.");
+    runOffsetCmd.SetParameterName("offset", false).SetRange("offset>=0");
+    runOffsetCmd.SetStates(G4State_PreInit, G4State_Idle);
+    runOffsetCmd.command->SetToBeBroadcasted(false);
+}
+
+EventSeeder::~EventSeeder()
+{
+    delete fMessenger;
+    fInstance = nullptr;
+}
+
+void EventSeeder::SetRunSeed(std::uint64_t runSeed)
+{
+    fRunSeed = runSeed;
+    fEnabled = true;
+}
+
+void EventSeeder::SeedEvent(G4int runID, G4int eventID) const
+{
+    if (!fEnabled)
+        return;
+
+    auto eventNumber = GetEventNumber(eventID);
+    auto runNumber = static_cast<std::uint32_t>(runID + fRunOffset);
+    auto random = Philox4x32({static_cast<std::uint32_t>(eventNumber), static_cast<std::uint32_t>(eventNumber >> 32), runNumber, fGeneration},
+                             {static_cast<std::uint32_t>(fRunSeed), static_cast<std::uint32_t>(fRunSeed >> 32)});
+
+    // positive, non-zero 31-bit seeds (valid for RanecuEngine, which uses the first two); zero-terminated
+    long seeds[5] = {static_cast<long>(random[0] % 2147483562) + 1, static_cast<long>(random[1] % 2147483398) + 1,
+                     static_cast<long>(random[2] >> 1) + 1, static_cast<long>(random[3] >> 1) + 1, 0};
+    G4Random::setTheSeeds(seeds, -1);
+}
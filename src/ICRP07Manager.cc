@@ -7,6 +7,7 @@
 
 #include "ICRP07Manager.hh"
 
+#include <algorithm>
 #include <fstream>
 
 ICRP07Manager *ICRP07Manager::instance = nullptr;
@@ -90,6 +91,24 @@ RadiationData ICRP07Manager::GetPhotonSourceAllDaughters(G4String nuclideName) c
     return photonSource;
 }
 
+std::vector<G4double> ICRP07Manager::GetPhotonEnergies() const
+{
+    std::vector<G4double> photonEnergies;
+    for (const auto &radiationData : fRadiationDatabase)
+        photonEnergies.insert(photonEnergies.end(), radiationData.second.fPhotonEnergies.begin(), radiationData.second.fPhotonEnergies.end());
+
+    std::sort(photonEnergies.begin(), photonEnergies.end());
+    photonEnergies.erase(std::unique(photonEnergies.begin(), photonEnergies.end()), photonEnergies.end());
+
+    return photonEnergies;
+}
+
+void ICRP07Manager::AddNuclide(G4String nuclideName, const DecayData &decayData, const RadiationData &radiationData)
+{
+    fDecayDatabase[nuclideName] = decayData;
+    fRadiationDatabase[nuclideName] = radiationData;
+}
+
 void ICRP07Manager::AppendRadiationData(RadiationData &originalData, RadiationData newData, G4double yieldMultiplier) const
 {
     std::for_each(newData.fYields.begin(), newData.fYields.end(),
@@ -120,6 +139,26 @@ void ICRP07Manager::RemoveRadiationDataByMinimumEnergy(RadiationData &originalDa
     }
 }
 
+void ICRP07Manager::RemoveRadiationDataByMaximumEnergy(RadiationData &originalData, G4double maximumEnergy) const
+{
+    auto iterEnergies = originalData.fPhotonEnergies.begin();
+    auto iterYields = originalData.fYields.begin();
+
+    while (iterEnergies != originalData.fPhotonEnergies.end())
+    {
+        if (*iterEnergies > maximumEnergy)
+        {
+            iterEnergies = originalData.fPhotonEnergies.erase(iterEnergies);
+            iterYields = originalData.fYields.erase(iterYields);
+        }
+        else
+        {
+            ++iterEnergies;
+            ++iterYields;
+        }
+    }
+}
+
 void ICRP07Manager::ImportNDX(G4String filepath)
 {
     std::ifstream ifs;
@@ -0,0 +1,91 @@
+#include "G4Event.hh"
+#include "G4GenericMessenger.hh"
+#include "G4IonTable.hh"
+#include "G4ParticleTable.hh"
+#include "G4PhysicalConstants.hh"
+#include "G4PrimaryParticle.hh"
+#include "G4PrimaryVertex.hh"
+#include "G4Run.hh"
+#include "G4RunManager.hh"
+#include "Randomize.hh"
+
+#include "PhaseSpaceGun.hh"
+#include "PhaseSpaceReader.hh"
+#include "PhaseSpaceWriter.hh"
+#include "EventSeeder.hh"
+
+#include <cstdlib>
+
+PhaseSpaceGun::PhaseSpaceGun()
+    : G4VPrimaryGenerator(), fNumberOfRecycles(1), fRotate(false), fOpenedRunID(-1), fReader(nullptr)
+{
+    // the writer of this thread owns the /advpg/phsp/ directory
+    auto messenger = PhaseSpaceWriter::Instance()->GetMessenger();
+    messenger->DeclareProperty("replay", fFileName,
+                               "Replay primaries from a .phsp or .IAEAphsp file instead of AdvancedParticleGun. "
+                               "An empty name switches back to AdvancedParticleGun.");
+    messenger->DeclareProperty("recycle", fNumberOfRecycles,
+                               "Number of consecutive events generated from each recorded history.")
+        .SetParameterName("nRecycles", false)
+        .SetRange("nRecycles>=1");
+    messenger->DeclareProperty("rotate", fRotate,
+                               "Rotate reused particles by a random angle around the z-axis.");
+}
+
+PhaseSpaceGun::~PhaseSpaceGun()
+{
+}
+
+void PhaseSpaceGun::GeneratePrimaryVertex(G4Event *event)
+{
+    // looked up again every run, so that a file that was missing or has been rewritten is picked up
+    auto runID = G4RunManager::GetRunManager()->GetCurrentRun()->GetRunID();
+    if (fFileName != fOpenedFileName || runID != fOpenedRunID)
+    {
+        fReader = PhaseSpaceReader::Open(fFileName);
+        fOpenedFileName = fFileName;
+        fOpenedRunID = runID;
+    }
+    if (!fReader || fReader->GetNumberOfStoredHistories() == 0)
+        return;
+
+    // all particles of one recorded history make up one event
+    auto nHistories = fReader->GetNumberOfStoredHistories();
+    auto use = static_cast<std::size_t>(EventSeeder::Instance()->GetEventNumber(event->GetEventID()));
+    std::size_t first, end;
+    fReader->GetHistory((use / fNumberOfRecycles) % nHistories, first, end);
+
+    auto isFirstUse = (use % fNumberOfRecycles == 0) && (use < nHistories * fNumberOfRecycles);
+    auto phi = (fRotate && !isFirstUse) ? twopi * G4UniformRand() : 0.;
+
+    PhaseSpaceRecord record;
+    for (auto index = first; index < end; ++index)
+    {
+        fReader->GetRecord(index, record);
+
+        G4ParticleDefinition *particleDefinition;
+        if (std::abs(record.fPDGCode) >= 1000000000)
+            particleDefinition = G4IonTable::GetIonTable()->GetIon(record.fPDGCode);
+        else
+            particleDefinition = G4ParticleTable::GetParticleTable()->FindParticle(record.fPDGCode);
+        if (!particleDefinition)
+            continue;
+
+        auto pos = G4ThreeVector(record.fX, record.fY, record.fZ);
+        auto dir = G4ThreeVector(record.fU, record.fV, record.fW).unit();
+        if (phi != 0.)
+        {
+            pos.rotateZ(phi);
+            dir.rotateZ(phi);
+        }
+
+        auto particle = new G4PrimaryParticle(particleDefinition);
+        particle->SetKineticEnergy(record.fKineticEnergy);
+        particle->SetMomentumDirection(dir);
+
+        auto vertex = new G4PrimaryVertex(pos, 0.);
+        vertex->SetPrimary(particle);
+        vertex->SetWeight(record.fWeight);
+        event->AddPrimaryVertex(vertex);
+    }
+}
@@ -0,0 +1,311 @@
+#include "G4AutoLock.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4UIcommand.hh"
+#include "G4ios.hh"
+
+#include "PhaseSpaceReader.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef G4MULTITHREADED
+G4Mutex PhaseSpaceReader::PhaseSpaceReaderMutex = G4MUTEX_INITIALIZER;
+#endif
+
+namespace
+{
+    std::map<G4String, std::shared_ptr<const PhaseSpaceReader>> readers;
+
+    G4bool EndsWith(const G4String &str, const G4String &suffix)
+    {
+        return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // IAEA particle codes: 1 photon, 2 electron, 3 positron, 4 neutron, 5 proton
+    G4int ConvertIAEATypeToPDG(G4int type)
+    {
+        switch (type)
+        {
+        case 1:
+            return 22;
+        case 2:
+            return 11;
+        case 3:
+            return -11;
+        case 4:
+            return 2112;
+        case 5:
+            return 2212;
+        default:
+            return 0;
+        }
+    }
+} // namespace
+
+std::shared_ptr<const PhaseSpaceReader> PhaseSpaceReader::Open(const G4String &fileName)
+{
+#ifdef G4MULTITHREADED
+    G4AutoLock lock(&PhaseSpaceReaderMutex);
+#endif
+    // a file replaced since it was mapped (e.g. by a later recording) is mapped again
+    FileID fileID;
+    auto iter = readers.find(fileName);
+    if (iter != readers.end() && GetFileID(GetDataName(fileName), fileID) && fileID == iter->second->fFileID)
+        return iter->second;
+    readers.erase(fileName);
+
+    std::shared_ptr<const PhaseSpaceReader> reader(new PhaseSpaceReader(fileName));
+    if (!reader->IsValid())
+        return nullptr;
+
+    G4cout << "Phase space: " << reader->GetNumberOfRecords() << " particles in " << reader->GetNumberOfStoredHistories() << " of "
+           << reader->GetNumberOfHistories() << " histories mapped from " << fileName << G4endl;
+    readers[fileName] = reader;
+
+    return reader;
+}
+
+G4String PhaseSpaceReader::GetDataName(const G4String &fileName)
+{
+    if (EndsWith(fileName, ".IAEAphsp") || EndsWith(fileName, ".IAEAheader"))
+        return fileName.substr(0, fileName.rfind('.')) + ".IAEAphsp";
+    return fileName;
+}
+
+G4bool PhaseSpaceReader::GetFileID(const G4String &fileName, FileID &fileID)
+{
+    struct stat st;
+    if (stat(fileName.c_str(), &st) != 0)
+        return false;
+
+    fileID.fDevice = st.st_dev;
+    fileID.fInode = st.st_ino;
+    fileID.fSize = st.st_size;
+    fileID.fModificationTime = st.st_mtime;
+    return true;
+}
+
+PhaseSpaceReader::PhaseSpaceReader(const G4String &fileName)
+    : fFileID{}, fMapping(nullptr), fMappingSize(0), fData(nullptr), fNumberOfRecords(0), fRecordLength(sizeof(PhaseSpaceRecord)),
+      fNumberOfHistories(0), fIsIAEA(false)
+{
+    auto dataName = GetDataName(fileName);
+    if (dataName != fileName || EndsWith(fileName, ".IAEAphsp"))
+    {
+        fIsIAEA = true;
+        if (!ImportIAEAHeader(dataName.substr(0, dataName.rfind('.')) + ".IAEAheader"))
+            return;
+    }
+
+    if (!Map(dataName))
+        return;
+
+    if (fIsIAEA)
+    {
+        fData = static_cast<const char *>(fMapping);
+        fNumberOfRecords = fMappingSize / fRecordLength;
+        FindHistoryStarts();
+        return;
+    }
+
+    PhaseSpaceHeader header;
+    if (fMappingSize < sizeof(header))
+    {
+        G4cerr << "WARNING: " << dataName << " is not a phase-space file.\n";
+        return;
+    }
+    std::memcpy(&header, fMapping, sizeof(header));
+    if (std::memcmp(header.fMagic, kPhaseSpaceMagic, sizeof(header.fMagic)) != 0)
+    {
+        G4cerr << "WARNING: " << dataName << " is not a phase-space file.\n";
+        return;
+    }
+
+    fData = static_cast<const char *>(fMapping) + sizeof(header);
+    fNumberOfRecords = std::min<std::size_t>(header.fNumberOfRecords, (fMappingSize - sizeof(header)) / fRecordLength);
+    fNumberOfHistories = header.fNumberOfHistories;
+    FindHistoryStarts();
+}
+
+PhaseSpaceReader::~PhaseSpaceReader()
+{
+    if (fMapping)
+        munmap(fMapping, fMappingSize);
+}
+
+G4bool PhaseSpaceReader::Map(const G4String &fileName)
+{
+    auto fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        G4cerr << "WARNING: There is no " << fileName << ".\n";
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        G4cerr << "WARNING: " << fileName << " is empty.\n";
+        return false;
+    }
+    fFileID.fDevice = st.st_dev;
+    fFileID.fInode = st.st_ino;
+    fFileID.fSize = st.st_size;
+    fFileID.fModificationTime = st.st_mtime;
+
+    auto mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        G4cerr << "WARNING: Cannot map " << fileName << ".\n";
+        return false;
+    }
+    madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+
+    fMapping = mapping;
+    fMappingSize = st.st_size;
+    return true;
+}
+
+G4bool PhaseSpaceReader::ImportIAEAHeader(const G4String &headerName)
+{
+    std::ifstream ifs;
+    ifs.open(headerName.c_str(), std::ios::in);
+    if (!ifs.is_open())
+    {
+        G4cerr << "WARNING: There is no " << headerName << ".\n";
+        return false;
+    }
+
+    // first token of every non-empty line, grouped by "$KEYWORD:" section
+    std::map<G4String, std::vector<G4String>> sections;
+    G4String section, theLine;
+    while (std::getline(ifs, theLine))
+    {
+        std::stringstream ss(theLine);
+        G4String token;
+        if (!(ss >> token))
+            continue;
+        if (token[0] == '$')
+            section = token;
+        else if (token.compare(0, 2, "//") != 0)
+            sections[section].push_back(token);
+    }
+    ifs.close();
+
+    if (!sections["$BYTE_ORDER:"].empty() && sections["$BYTE_ORDER:"][0] != "1234")
+    {
+        G4cerr << "WARNING: " << headerName << " is not little-endian.\n";
+        return false;
+    }
+
+    const auto &contents = sections["$RECORD_CONTENTS:"];
+    const auto &constants = sections["$RECORD_CONSTANT:"];
+    if (contents.size() < kNumberOfIAEAVariables || sections["$RECORD_LENGTH:"].empty())
+    {
+        G4cerr << "WARNING: " << headerName << " has no record layout.\n";
+        return false;
+    }
+
+    std::size_t iConstant = 0;
+    for (G4int i = 0; i < kNumberOfIAEAVariables; ++i)
+    {
+        fIAEAStored[i] = G4UIcommand::ConvertToInt(contents[i]) != 0;
+        fIAEAConstants[i] = (i == kWeight) ? 1. : 0.;
+        if (!fIAEAStored[i] && iConstant < constants.size())
+            fIAEAConstants[i] = G4UIcommand::ConvertToDouble(constants[iConstant++]);
+    }
+
+    fRecordLength = G4UIcommand::ConvertToInt(sections["$RECORD_LENGTH:"][0]);
+    if (!sections["$ORIG_HISTORIES:"].empty())
+        fNumberOfHistories = std::stoull(sections["$ORIG_HISTORIES:"][0]);
+
+    return fRecordLength > 0;
+}
+
+void PhaseSpaceReader::FindHistoryStarts()
+{
+    // IAEA records open a new history with a negative energy; native records change the history number
+    fHistoryStarts.clear();
+    std::uint32_t lastHistory = 0;
+    for (std::size_t index = 0; index < fNumberOfRecords; ++index)
+    {
+        auto data = fData + index * fRecordLength;
+        G4bool isNewHistory;
+        if (fIsIAEA)
+        {
+            float energy;
+            std::memcpy(&energy, data + 1, sizeof(energy));
+            isNewHistory = std::signbit(energy);
+        }
+        else
+        {
+            std::uint32_t history;
+            std::memcpy(&history, data + offsetof(PhaseSpaceRecord, fHistory), sizeof(history));
+            isNewHistory = (history != lastHistory);
+            lastHistory = history;
+        }
+        if (index == 0 || isNewHistory)
+            fHistoryStarts.push_back(index);
+    }
+}
+
+void PhaseSpaceReader::GetRecord(std::size_t index, PhaseSpaceRecord &record) const
+{
+    if (fIsIAEA)
+        GetIAEARecord(index, record);
+    else
+        std::memcpy(&record, fData + index * fRecordLength, sizeof(PhaseSpaceRecord));
+}
+
+void PhaseSpaceReader::GetIAEARecord(std::size_t index, PhaseSpaceRecord &record) const
+{
+    // layout: type (int8, sign = sign of W), E (sign = new history), X, Y, Z, U, V, weight
+    auto data = fData + index * fRecordLength;
+    auto type = static_cast<signed char>(data[0]);
+    std::size_t offset = 1;
+
+    float value;
+    std::memcpy(&value, data + offset, sizeof(value));
+    offset += sizeof(value);
+    record.fKineticEnergy = std::abs(value) * MeV;
+
+    G4double values[kNumberOfIAEAVariables];
+    for (G4int i = 0; i < kNumberOfIAEAVariables; ++i)
+    {
+        values[i] = fIAEAConstants[i];
+        if (i == kW || !fIAEAStored[i])
+            continue;
+        std::memcpy(&value, data + offset, sizeof(value));
+        offset += sizeof(value);
+        values[i] = value;
+    }
+    if (fIAEAStored[kW])
+    {
+        auto w2 = 1. - values[kU] * values[kU] - values[kV] * values[kV];
+        values[kW] = (w2 > 0.) ? std::sqrt(w2) : 0.;
+        if (type < 0)
+            values[kW] = -values[kW];
+    }
+
+    record.fPDGCode = ConvertIAEATypeToPDG(std::abs(type));
+    record.fX = static_cast<float>(values[kX] * cm);
+    record.fY = static_cast<float>(values[kY] * cm);
+    record.fZ = static_cast<float>(values[kZ] * cm);
+    record.fU = static_cast<float>(values[kU]);
+    record.fV = static_cast<float>(values[kV]);
+    record.fW = static_cast<float>(values[kW]);
+    record.fWeight = static_cast<float>(values[kWeight]);
+    record.fHistory = 0;
+}
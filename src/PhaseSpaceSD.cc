@@ -0,0 +1,53 @@
+#include "G4Event.hh"
+#include "G4EventManager.hh"
+#include "G4Step.hh"
+#include "G4VTouchable.hh"
+
+#include "PhaseSpaceSD.hh"
+#include "PhaseSpaceWriter.hh"
+#include "EventSeeder.hh"
+
+PhaseSpaceSD::PhaseSpaceSD(G4String name)
+    : G4VSensitiveDetector(name)
+{
+}
+
+PhaseSpaceSD::~PhaseSpaceSD()
+{
+}
+
+G4bool PhaseSpaceSD::ProcessHits(G4Step *step, G4TouchableHistory *)
+{
+    auto writer = PhaseSpaceWriter::Instance();
+    if (!writer->IsOpen())
+        return false;
+
+    auto preStepPoint = step->GetPreStepPoint();
+    if (preStepPoint->GetStepStatus() != fGeomBoundary)
+        return false;
+
+    auto pos = preStepPoint->GetPosition();
+    auto dir = preStepPoint->GetMomentumDirection();
+    if ((pos - preStepPoint->GetTouchable()->GetTranslation()).dot(dir) >= 0.)
+        return false;
+
+    auto pdgCode = step->GetTrack()->GetDefinition()->GetPDGEncoding();
+    if (pdgCode == 0)
+        return false;
+
+    PhaseSpaceRecord record;
+    record.fPDGCode = pdgCode;
+    record.fX = static_cast<float>(pos.x());
+    record.fY = static_cast<float>(pos.y());
+    record.fZ = static_cast<float>(pos.z());
+    record.fU = static_cast<float>(dir.x());
+    record.fV = static_cast<float>(dir.y());
+    record.fW = static_cast<float>(dir.z());
+    record.fKineticEnergy = static_cast<float>(preStepPoint->GetKineticEnergy());
+    record.fWeight = static_cast<float>(preStepPoint->GetWeight());
+    auto eventID = G4EventManager::GetEventManager()->GetConstCurrentEvent()->GetEventID();
+    record.fHistory = static_cast<std::uint32_t>(EventSeeder::Instance()->GetEventNumber(eventID));
+    writer->Fill(record);
+
+    return true;
+}
@@ -0,0 +1,172 @@
+#include "G4GenericMessenger.hh"
+#include "G4SDManager.hh"
+#include "G4ios.hh"
+
+#include "PhaseSpaceWriter.hh"
+#include "ShardManager.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+    constexpr std::size_t kBufferSize = 4096;
+}
+
+G4ThreadLocal PhaseSpaceWriter *PhaseSpaceWriter::fInstance = nullptr;
+
+PhaseSpaceWriter *PhaseSpaceWriter::Instance()
+{
+    if (fInstance == nullptr)
+        fInstance = new PhaseSpaceWriter;
+
+    return fInstance;
+}
+
+PhaseSpaceWriter::PhaseSpaceWriter()
+    : fNumberOfRecords(0)
+{
+    fBuffer.reserve(kBufferSize);
+
+    fMessenger = new G4GenericMessenger(this, "/advpg/phsp/", "Phase-space recording and replay");
+    fMessenger->DeclareProperty("record", fFileName,
+                                "Record particles entering the phase-space surface into <name>.phsp. "
+                                "An empty name disables recording.");
+}
+
+PhaseSpaceWriter::~PhaseSpaceWriter()
+{
+    if (fFile.is_open())
+        Close(0);
+    delete fMessenger;
+    fInstance = nullptr;
+}
+
+G4String PhaseSpaceWriter::GetThreadFileName(G4int threadID) const
+{
+    auto fileName = ShardManager::Instance()->GetOutputName(fFileName);
+    if (threadID < 0)
+        return fileName + ".phsp";
+    return fileName + "_t" + std::to_string(threadID) + ".phsp";
+}
+
+void PhaseSpaceWriter::Open()
+{
+    if (fFileName.empty())
+        return;
+    if (!G4SDManager::GetSDMpointer()->FindSensitiveDetector("PhaseSpaceSurface", false))
+    {
+        if (G4Threading::G4GetThreadId() <= 0)
+            G4cerr << "WARNING: Nothing is recorded into " << fFileName << ": the PhaseSpaceSurface is only built with -phsp.\n";
+        return;
+    }
+
+    // a replayed file may still be mapped: unlinking keeps the mapping valid, truncating would not
+    auto fileName = GetThreadFileName(G4Threading::G4GetThreadId());
+    std::remove(fileName.c_str());
+    fFile.open(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!fFile.is_open())
+    {
+        G4cerr << "WARNING: Cannot open " << fileName << ".\n";
+        return;
+    }
+
+    // placeholder header, rewritten with the final counts by Close()
+    PhaseSpaceHeader header{};
+    fFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    fNumberOfRecords = 0;
+}
+
+void PhaseSpaceWriter::Fill(const PhaseSpaceRecord &record)
+{
+    fBuffer.push_back(record);
+    if (fBuffer.size() == kBufferSize)
+        Flush();
+}
+
+void PhaseSpaceWriter::Flush()
+{
+    fFile.write(reinterpret_cast<const char *>(fBuffer.data()), fBuffer.size() * sizeof(PhaseSpaceRecord));
+    fNumberOfRecords += fBuffer.size();
+    fBuffer.clear();
+}
+
+void PhaseSpaceWriter::Close(G4int numberOfHistories)
+{
+    if (!fFile.is_open())
+        return;
+
+    Flush();
+
+    PhaseSpaceHeader header{};
+    std::memcpy(header.fMagic, kPhaseSpaceMagic, sizeof(header.fMagic));
+    header.fNumberOfRecords = fNumberOfRecords;
+    header.fNumberOfHistories = numberOfHistories;
+    fFile.seekp(0);
+    fFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    fFile.close();
+}
+
+void PhaseSpaceWriter::Merge(G4int numberOfThreads) const
+{
+    if (fFileName.empty())
+        return;
+
+    // written aside and renamed, so that a replayed mapping of the previous file stays valid
+    auto fileName = GetThreadFileName(-1);
+    auto tmpFileName = fileName + ".tmp";
+    std::ofstream ofs(tmpFileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open())
+    {
+        G4cerr << "WARNING: Cannot open " << tmpFileName << ".\n";
+        return;
+    }
+
+    PhaseSpaceHeader mergedHeader{};
+    std::memcpy(mergedHeader.fMagic, kPhaseSpaceMagic, sizeof(mergedHeader.fMagic));
+    ofs.write(reinterpret_cast<const char *>(&mergedHeader), sizeof(mergedHeader));
+
+    std::vector<PhaseSpaceRecord> buffer(kBufferSize);
+    for (G4int threadID = 0; threadID < numberOfThreads; ++threadID)
+    {
+        auto threadFileName = GetThreadFileName(threadID);
+        std::ifstream ifs(threadFileName.c_str(), std::ios::in | std::ios::binary);
+        if (!ifs.is_open())
+            continue;
+
+        PhaseSpaceHeader header;
+        ifs.read(reinterpret_cast<char *>(&header), sizeof(header));
+        if (!ifs || std::memcmp(header.fMagic, kPhaseSpaceMagic, sizeof(header.fMagic)) != 0)
+        {
+            G4cerr << "WARNING: " << threadFileName << " is not a complete phase-space file.\n";
+            continue;
+        }
+
+        auto remaining = header.fNumberOfRecords;
+        while (remaining > 0)
+        {
+            auto n = std::min<std::uint64_t>(remaining, buffer.size());
+            ifs.read(reinterpret_cast<char *>(buffer.data()), n * sizeof(PhaseSpaceRecord));
+            ofs.write(reinterpret_cast<const char *>(buffer.data()), n * sizeof(PhaseSpaceRecord));
+            remaining -= n;
+        }
+        mergedHeader.fNumberOfRecords += header.fNumberOfRecords;
+        mergedHeader.fNumberOfHistories += header.fNumberOfHistories;
+
+        ifs.close();
+        std::remove(threadFileName.c_str());
+    }
+
+    ofs.seekp(0);
+    ofs.write(reinterpret_cast<const char *>(&mergedHeader), sizeof(mergedHeader));
+    ofs.close();
+    if (!ofs || std::rename(tmpFileName.c_str(), fileName.c_str()) != 0)
+    {
+        G4cerr << "WARNING: Cannot write " << fileName << ".\n";
+        return;
+    }
+
+    G4cout << "Phase space: " << mergedHeader.fNumberOfRecords << " particles from "
+           << mergedHeader.fNumberOfHistories << " histories written to " << fileName << G4endl;
+}
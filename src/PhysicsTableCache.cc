@@ -0,0 +1,73 @@
+#include "G4Material.hh"
+#include "G4VUserPhysicsList.hh"
+#include "G4Version.hh"
+#include "G4ios.hh"
+
+#include "PhysicsTableCache.hh"
+
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+
+#include <sys/stat.h>
+
+PhysicsTableCache *PhysicsTableCache::Instance()
+{
+    static PhysicsTableCache cache;
+    return &cache;
+}
+
+PhysicsTableCache::PhysicsTableCache()
+    : fPhysicsList(nullptr), fRetrieved(false), fStored(false)
+{
+}
+
+void PhysicsTableCache::Configure(const G4String &cacheDir, const G4String &physicsName, G4VUserPhysicsList *physicsList)
+{
+    fPhysicsList = physicsList;
+
+    std::ostringstream key;
+    key << "geant4 " << G4VERSION_NUMBER << "\nphysics " << physicsName
+        << "\ncut " << std::setprecision(17) << physicsList->GetDefaultCutValue() << "\nmaterials";
+    for (const auto material : *G4Material::GetMaterialTable())
+        key << " " << material->GetName();
+    key << "\n";
+    fKey = key.str();
+
+    std::ostringstream subDir;
+    subDir << std::hex << std::hash<std::string>()(fKey);
+    mkdir(cacheDir.c_str(), 0755);
+    fDirectory = cacheDir + "/" + subDir.str();
+    mkdir(fDirectory.c_str(), 0755);
+
+    std::ifstream ifs(GetKeyFileName().c_str());
+    std::stringstream storedKey;
+    if (ifs.is_open())
+        storedKey << ifs.rdbuf();
+    if (storedKey.str() == fKey)
+    {
+        fPhysicsList->SetPhysicsTableRetrieved(fDirectory);
+        fRetrieved = true;
+        G4cout << "Physics tables: retrieved from " << fDirectory << G4endl;
+    }
+    else
+        G4cout << "Physics tables: built from scratch and stored to " << fDirectory << " after the first run" << G4endl;
+}
+
+void PhysicsTableCache::Store()
+{
+    if (!fPhysicsList || fRetrieved || fStored)
+        return;
+    fStored = true;
+
+    if (!fPhysicsList->StorePhysicsTable(fDirectory))
+    {
+        G4cerr << "WARNING: Cannot store the physics tables to " << fDirectory << ".\n";
+        return;
+    }
+
+    // the key is written last, so an interrupted store is never retrieved
+    std::ofstream ofs(GetKeyFileName().c_str(), std::ios::out | std::ios::trunc);
+    ofs << fKey;
+}
@@ -0,0 +1,417 @@
+#include "G4AutoLock.hh"
+#include "G4EmCalculator.hh"
+#include "G4EmProcessSubType.hh"
+#include "G4Gamma.hh"
+#include "G4GammaGeneralProcess.hh"
+#include "G4GenericMessenger.hh"
+#include "G4Material.hh"
+#include "G4Navigator.hh"
+#include "G4PhysicalConstants.hh"
+#include "G4Step.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4TransportationManager.hh"
+#include "G4UIcommand.hh"
+#include "G4VPhysicalVolume.hh"
+#include "G4ios.hh"
+
+#include "PointDetectorEstimator.hh"
+#include "AdvancedParticleGun.hh"
+#include "EnergyGrid.hh"
+#include "ShardManager.hh"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+PointDetectorEstimator *PointDetectorEstimator::fInstance = nullptr;
+G4ThreadLocal PointDetectorEstimator::Tally *PointDetectorEstimator::fThreadTally = nullptr;
+G4ThreadLocal G4Navigator *PointDetectorEstimator::fNavigator = nullptr;
+#ifdef G4MULTITHREADED
+G4Mutex PointDetectorEstimator::PointDetectorEstimatorMutex = G4MUTEX_INITIALIZER;
+#endif
+
+namespace
+{
+    // rays beyond this optical depth contribute nothing
+    const G4double kMaxOpticalDepth = 50.;
+
+    // ICRP 74, Table A.1: air kerma per fluence (pGy cm2) of photons
+    const G4double kKermaEnergies[] = {.01, .015, .02, .03, .04, .05, .06, .08, .1, .15, .2, .3, .4,
+                                       .5, .6, .8, 1., 1.5, 2., 3., 4., 5., 6., 8., 10.};
+    const G4double kKermaPerFluence[] = {7.6, 3.21, 1.73, .739, .438, .328, .292, .308, .372, .6, .856, 1.38, 1.89,
+                                         2.38, 2.84, 3.69, 4.47, 6.14, 7.55, 9.96, 12.1, 14.1, 16.1, 20.1, 24.};
+    const G4int kNumberOfKermaEnergies = sizeof(kKermaEnergies) / sizeof(kKermaEnergies[0]);
+} // namespace
+
+PointDetectorEstimator *PointDetectorEstimator::Instance()
+{
+    if (fInstance == nullptr)
+    {
+#ifdef G4MULTITHREADED
+        G4MUTEXLOCK(&PointDetectorEstimatorMutex);
+        if (fInstance == nullptr)
+        {
+#endif
+            fInstance = new PointDetectorEstimator;
+#ifdef G4MULTITHREADED
+        }
+        G4MUTEXUNLOCK(&PointDetectorEstimatorMutex);
+#endif
+    }
+
+    return fInstance;
+}
+
+PointDetectorEstimator::PointDetectorEstimator()
+    : fExclusionRadius(1. * cm), fActivity(0.)
+{
+    fMessenger = new G4GenericMessenger(this, "/advpg/nee/", "Next-event estimator at point receptors");
+
+    auto &addCmd = fMessenger->DeclareMethod("addReceptor", &PointDetectorEstimator::AddReceptor,
+                                             "Add a point receptor: <x> <y> <z> <unit>.");
+    addCmd.SetStates(G4State_PreInit, G4State_Idle);
+    addCmd.command->SetToBeBroadcasted(false);
+
+    auto &clearCmd = fMessenger->DeclareMethod("clearReceptors", &PointDetectorEstimator::ClearReceptors,
+                                               "Remove all point receptors.");
+    clearCmd.SetStates(G4State_PreInit, G4State_Idle);
+    clearCmd.command->SetToBeBroadcasted(false);
+
+    auto &radiusCmd = fMessenger->DeclarePropertyWithUnit("exclusionRadius", "cm", fExclusionRadius,
+                                                          "Collisions closer to a receptor score as if at this distance, "
+                                                          "which bounds the variance of the 1/R^2 singularity.");
+    radiusCmd.SetStates(G4State_PreInit, G4State_Idle);
+    radiusCmd.command->SetToBeBroadcasted(false);
+
+    auto &activityCmd = fMessenger->DeclarePropertyWithUnit("activity", "Bq", fActivity,
+                                                            "Source activity (histories per second) for the air kerma rate.");
+    activityCmd.SetStates(G4State_PreInit, G4State_Idle);
+    activityCmd.command->SetToBeBroadcasted(false);
+}
+
+PointDetectorEstimator::~PointDetectorEstimator()
+{
+    delete fMessenger;
+    fInstance = nullptr;
+}
+
+void PointDetectorEstimator::Tally::Reset(std::size_t numberOfReceptors)
+{
+    fFluence.assign(numberOfReceptors, 0.);
+    fKerma.assign(numberOfReceptors, 0.);
+    fSumFluence.assign(numberOfReceptors, 0.);
+    fSumFluence2.assign(numberOfReceptors, 0.);
+    fSumKerma.assign(numberOfReceptors, 0.);
+    fSumKerma2.assign(numberOfReceptors, 0.);
+    fNumberOfHistories = 0;
+}
+
+void PointDetectorEstimator::AddReceptor(G4String parameters)
+{
+    std::istringstream iss(parameters);
+    G4double x, y, z;
+    G4String unit;
+    if (!(iss >> x >> y >> z >> unit))
+    {
+        G4cerr << "WARNING: addReceptor expects <x> <y> <z> <unit>.\n";
+        return;
+    }
+
+    fReceptors.push_back(G4ThreeVector(x, y, z) * G4UIcommand::ValueOf(unit));
+}
+
+void PointDetectorEstimator::ClearReceptors()
+{
+    fReceptors.clear();
+}
+
+void PointDetectorEstimator::BeginOfRun()
+{
+    fTotal.Reset(fReceptors.size());
+    if (IsEnabled() && fAttenuationCoefficients.size() != G4Material::GetNumberOfMaterials())
+        BuildAttenuationTables();
+}
+
+void PointDetectorEstimator::BuildAttenuationTables()
+{
+    G4EmCalculator emCalculator;
+    fAttenuationCoefficients.assign(G4Material::GetNumberOfMaterials(), std::vector<G4double>(EnergyGrid::kNumberOfEnergies, 0.));
+    for (const auto material : *G4Material::GetMaterialTable())
+    {
+        auto &coefficients = fAttenuationCoefficients[material->GetIndex()];
+        for (G4int i = 0; i < EnergyGrid::kNumberOfEnergies; ++i)
+        {
+            auto energy = EnergyGrid::GetEnergy(i);
+            auto length = emCalculator.ComputeGammaAttenuationLength(energy, material);
+            coefficients[i] = (length > 0. && length < DBL_MAX) ? 1. / length : 0.;
+        }
+    }
+}
+
+G4double PointDetectorEstimator::GetAttenuationCoefficient(G4double energy, const G4Material *material) const
+{
+    const auto &coefficients = fAttenuationCoefficients[material->GetIndex()];
+    auto x = EnergyGrid::GetIndex(energy);
+    auto i = std::min(static_cast<G4int>(x), EnergyGrid::kNumberOfEnergies - 2);
+    auto f = std::min(x - i, 1.);
+    return coefficients[i] + f * (coefficients[i + 1] - coefficients[i]);
+}
+
+G4double PointDetectorEstimator::GetTransmission(const G4ThreeVector &start, const G4ThreeVector &end, G4double energy) const
+{
+    auto direction = (end - start).unit();
+    auto remaining = (end - start).mag();
+    auto position = start;
+    auto volume = fNavigator->LocateGlobalPointAndSetup(position, &direction, false, false);
+
+    G4double opticalDepth = 0.;
+    for (G4int nSteps = 0; volume && remaining > 0. && nSteps < 10000; ++nSteps)
+    {
+        G4double safety;
+        auto step = std::min(fNavigator->ComputeStep(position, direction, remaining, safety), remaining);
+        opticalDepth += GetAttenuationCoefficient(energy, volume->GetLogicalVolume()->GetMaterial()) * step;
+        if (opticalDepth > kMaxOpticalDepth)
+            return 0.;
+
+        remaining -= step;
+        position += step * direction;
+        fNavigator->SetGeometricallyLimitedStep();
+        volume = fNavigator->LocateGlobalPointAndSetup(position, &direction, true);
+    }
+
+    return std::exp(-opticalDepth);
+}
+
+void PointDetectorEstimator::Score(std::size_t receptor, const G4ThreeVector &position, G4double energy, G4double weightPerSolidAngle)
+{
+    if (weightPerSolidAngle <= 0.)
+        return;
+
+    auto distance = std::max((fReceptors[receptor] - position).mag(), fExclusionRadius);
+    auto transmission = GetTransmission(position, fReceptors[receptor], energy);
+    if (transmission <= 0.)
+        return;
+
+    auto fluence = weightPerSolidAngle * transmission / (distance * distance);
+    fThreadTally->fFluence[receptor] += fluence;
+    fThreadTally->fKerma[receptor] += fluence * GetAirKermaPerFluence(energy);
+}
+
+void PointDetectorEstimator::BeginOfWorkerRun()
+{
+    if (!IsEnabled())
+        return;
+
+    if (!fThreadTally)
+        fThreadTally = new Tally;
+    fThreadTally->Reset(fReceptors.size());
+
+    // a private navigator, so that the rays do not disturb the tracking
+    if (!fNavigator)
+        fNavigator = new G4Navigator;
+    fNavigator->SetWorldVolume(G4TransportationManager::GetTransportationManager()->GetNavigatorForTracking()->GetWorldVolume());
+}
+
+void PointDetectorEstimator::ScoreEmission(const AdvancedParticleGun &gun, const PrimarySample &sample)
+{
+    if (!IsEnabled() || gun.GetParticleDefinition() != G4Gamma::Definition())
+        return;
+
+    for (std::size_t receptor = 0; receptor < fReceptors.size(); ++receptor)
+    {
+        auto direction = (fReceptors[receptor] - sample.fPosition).unit();
+        Score(receptor, sample.fPosition, sample.fEnergy, gun.GetEmissionDensity(sample, direction));
+    }
+}
+
+void PointDetectorEstimator::ScoreCollision(const G4Step *step)
+{
+    if (!IsEnabled() || step->GetTrack()->GetDefinition() != G4Gamma::Definition())
+        return;
+
+    auto postStepPoint = step->GetPostStepPoint();
+    auto process = postStepPoint->GetProcessDefinedStep();
+    if (!process)
+        return;
+    auto subType = process->GetProcessSubType();
+    if (auto generalProcess = dynamic_cast<const G4GammaGeneralProcess *>(process))
+        subType = generalProcess->GetSubProcessSubType();
+    if (subType != fComptonScattering && subType != fRayleigh)
+        return;
+
+    auto preStepPoint = step->GetPreStepPoint();
+    auto energy = preStepPoint->GetKineticEnergy();
+    auto direction = preStepPoint->GetMomentumDirection();
+    auto weight = preStepPoint->GetWeight();
+    auto position = postStepPoint->GetPosition();
+    for (std::size_t receptor = 0; receptor < fReceptors.size(); ++receptor)
+    {
+        auto cosTheta = direction.dot((fReceptors[receptor] - position).unit());
+        if (subType == fComptonScattering)
+        {
+            auto scatteredEnergy = energy / (1. + energy / electron_mass_c2 * (1. - cosTheta));
+            Score(receptor, position, scatteredEnergy, weight * GetKleinNishinaDensity(energy, cosTheta));
+        }
+        else
+        {
+            // Thomson angular distribution, i.e. without atomic form factors
+            Score(receptor, position, energy, weight * 3. / (16. * pi) * (1. + cosTheta * cosTheta));
+        }
+    }
+}
+
+void PointDetectorEstimator::EndOfEvent()
+{
+    if (!IsEnabled())
+        return;
+
+    auto tally = fThreadTally;
+    for (std::size_t receptor = 0; receptor < fReceptors.size(); ++receptor)
+    {
+        tally->fSumFluence[receptor] += tally->fFluence[receptor];
+        tally->fSumFluence2[receptor] += tally->fFluence[receptor] * tally->fFluence[receptor];
+        tally->fSumKerma[receptor] += tally->fKerma[receptor];
+        tally->fSumKerma2[receptor] += tally->fKerma[receptor] * tally->fKerma[receptor];
+        tally->fFluence[receptor] = tally->fKerma[receptor] = 0.;
+    }
+    ++tally->fNumberOfHistories;
+}
+
+void PointDetectorEstimator::EndOfWorkerRun()
+{
+    if (!IsEnabled())
+        return;
+
+#ifdef G4MULTITHREADED
+    G4AutoLock lock(&PointDetectorEstimatorMutex);
+#endif
+    for (std::size_t receptor = 0; receptor < fReceptors.size(); ++receptor)
+    {
+        fTotal.fSumFluence[receptor] += fThreadTally->fSumFluence[receptor];
+        fTotal.fSumFluence2[receptor] += fThreadTally->fSumFluence2[receptor];
+        fTotal.fSumKerma[receptor] += fThreadTally->fSumKerma[receptor];
+        fTotal.fSumKerma2[receptor] += fThreadTally->fSumKerma2[receptor];
+    }
+    fTotal.fNumberOfHistories += fThreadTally->fNumberOfHistories;
+}
+
+void PointDetectorEstimator::GetThreadTallies(std::vector<G4double> &tallies) const
+{
+    tallies.clear();
+    if (!IsEnabled() || !fThreadTally)
+        return;
+
+    for (const auto sums : {&Tally::fSumFluence, &Tally::fSumFluence2, &Tally::fSumKerma, &Tally::fSumKerma2})
+        tallies.insert(tallies.end(), (fThreadTally->*sums).begin(), (fThreadTally->*sums).end());
+    tallies.push_back(static_cast<G4double>(fThreadTally->fNumberOfHistories));
+}
+
+G4bool PointDetectorEstimator::AddTallies(const std::vector<G4double> &tallies)
+{
+    if (tallies.empty())
+        return true;
+    auto nReceptors = fReceptors.size();
+    if (!IsEnabled() || tallies.size() != 4 * nReceptors + 1)
+        return false;
+
+    auto value = tallies.begin();
+    for (const auto sums : {&Tally::fSumFluence, &Tally::fSumFluence2, &Tally::fSumKerma, &Tally::fSumKerma2})
+    {
+        for (std::size_t receptor = 0; receptor < nReceptors; ++receptor)
+            (fTotal.*sums)[receptor] += *value++;
+    }
+    fTotal.fNumberOfHistories += static_cast<std::uint64_t>(*value);
+    return true;
+}
+
+void PointDetectorEstimator::EndOfRun() const
+{
+    if (!IsEnabled())
+        return;
+
+    // the sums are written rather than the means, so that advpg_merge can add the files of several shards
+    auto fileName = ShardManager::Instance()->GetOutputName("NEE") + ".csv";
+    std::ofstream ofs(fileName.c_str());
+    if (ofs.is_open())
+    {
+        ofs << "#class advpg::nee\n"
+            << "#title Point receptors, positions in cm, fluence in /cm2, air kerma in Gy\n"
+            << "#histories " << fTotal.fNumberOfHistories << "\n"
+            << "#activity " << fActivity / becquerel << "\n"
+            << "receptor,x,y,z,sum_fluence,sum_fluence2,sum_kerma,sum_kerma2\n";
+        ofs.precision(std::numeric_limits<G4double>::max_digits10);
+        for (std::size_t receptor = 0; receptor < fReceptors.size(); ++receptor)
+        {
+            const auto position = fReceptors[receptor] / cm;
+            ofs << receptor << "," << position.x() << "," << position.y() << "," << position.z() << ","
+                << fTotal.fSumFluence[receptor] * cm2 << "," << fTotal.fSumFluence2[receptor] * cm2 * cm2 << ","
+                << fTotal.fSumKerma[receptor] / gray << "," << fTotal.fSumKerma2[receptor] / (gray * gray) << "\n";
+        }
+    }
+    else
+        G4cerr << "WARNING: Cannot write " << fileName << ".\n";
+
+    auto nHistories = static_cast<G4double>(fTotal.fNumberOfHistories);
+    if (nHistories < 2.)
+        return;
+
+    // relative standard error of the mean over histories
+    auto relativeError = [nHistories](G4double sum, G4double sum2)
+    {
+        if (sum <= 0.)
+            return 0.;
+        auto mean = sum / nHistories;
+        auto variance = std::max(sum2 / nHistories - mean * mean, 0.) / (nHistories - 1.);
+        return std::sqrt(variance) / mean;
+    };
+
+    for (std::size_t receptor = 0; receptor < fReceptors.size(); ++receptor)
+    {
+        auto fluence = fTotal.fSumFluence[receptor] / nHistories;
+        auto kerma = fTotal.fSumKerma[receptor] / nHistories;
+        G4cout << "NEE receptor " << receptor << " at " << fReceptors[receptor] / cm << " cm: fluence "
+               << fluence * cm2 << " /cm2 (" << 100. * relativeError(fTotal.fSumFluence[receptor], fTotal.fSumFluence2[receptor])
+               << " %), air kerma " << kerma / gray << " Gy ("
+               << 100. * relativeError(fTotal.fSumKerma[receptor], fTotal.fSumKerma2[receptor]) << " %) per history";
+        if (fActivity > 0.)
+            G4cout << ", air kerma rate " << kerma * fActivity / (gray / (3600. * s)) << " Gy/h";
+        G4cout << G4endl;
+    }
+    G4cout << "NEE: " << fReceptors.size() << " receptors, " << fTotal.fNumberOfHistories << " histories written to " << fileName << G4endl;
+}
+
+G4double PointDetectorEstimator::GetKleinNishinaDensity(G4double energy, G4double cosTheta)
+{
+    // dsigma/dOmega and sigma in units of the classical electron radius squared
+    auto k = energy / electron_mass_c2;
+    auto ratio = 1. / (1. + k * (1. - cosTheta));
+    auto differential = .5 * ratio * ratio * (ratio + 1. / ratio - (1. - cosTheta * cosTheta));
+
+    G4double total;
+    if (k < 1e-3)
+        total = 8. * pi / 3. * (1. - 2. * k + 5.2 * k * k);
+    else
+    {
+        auto log12k = std::log(1. + 2. * k);
+        total = twopi * ((1. + k) / (k * k) * (2. * (1. + k) / (1. + 2. * k) - log12k / k) + log12k / (2. * k) -
+                         (1. + 3. * k) / ((1. + 2. * k) * (1. + 2. * k)));
+    }
+
+    return differential / total;
+}
+
+G4double PointDetectorEstimator::GetAirKermaPerFluence(G4double energy)
+{
+    // log-log interpolation, extrapolated from the end segments outside the table
+    auto e = energy / MeV;
+    auto i = static_cast<G4int>(std::upper_bound(kKermaEnergies, kKermaEnergies + kNumberOfKermaEnergies, e) - kKermaEnergies) - 1;
+    i = std::min(std::max(i, 0), kNumberOfKermaEnergies - 2);
+
+    auto slope = std::log(kKermaPerFluence[i + 1] / kKermaPerFluence[i]) / std::log(kKermaEnergies[i + 1] / kKermaEnergies[i]);
+    auto value = kKermaPerFluence[i] * std::pow(e / kKermaEnergies[i], slope);
+
+    return value * 1e-12 * gray * cm2;
+}
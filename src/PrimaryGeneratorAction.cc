@@ -1,27 +1,169 @@
+#include "G4Event.hh"
 #include "G4Gamma.hh"
+#include "G4GenericMessenger.hh"
+#include "G4Run.hh"
+#include "G4RunManager.hh"
 #include "G4RandomTools.hh"
 #include "G4SystemOfUnits.hh"
+#include "G4UIcommand.hh"
 
 #include "PrimaryGeneratorAction.hh"
 #include "AdvancedParticleGun.hh"
+#include "PhaseSpaceGun.hh"
+#include "PrimaryPipeline.hh"
+#include "EventSeeder.hh"
+#include "CheckpointManager.hh"
+#include "StartupProfiler.hh"
+#include "ThreadProfiler.hh"
+#include "PointDetectorEstimator.hh"
+#include "ResponseMatrix.hh"
+
+#include <sstream>
 
 PrimaryGeneratorAction::PrimaryGeneratorAction()
-    : G4VUserPrimaryGeneratorAction()
+    : G4VUserPrimaryGeneratorAction(), fRunID(-1)
 {
     fPrimary = new AdvancedParticleGun();
+    fPrimary->SetNuclideSource("Cs-137");
+    fPrimary->SetMinPhotonEnergy(10. * keV);
+    fPhaseSpace = new PhaseSpaceGun();
+
+    DefineCommands();
 }
 
 PrimaryGeneratorAction::~PrimaryGeneratorAction()
 {
+    delete fMessenger;
     delete fPrimary;
+    delete fPhaseSpace;
+}
+
+void PrimaryGeneratorAction::DefineCommands()
+{
+    fMessenger = new G4GenericMessenger(this, "/advpg/source/", "Nuclide source sampling");
+    fMessenger->DeclareMethod("nuclide", &PrimaryGeneratorAction::SetNuclideCommand,
+                              "ICRP 107 nuclide emitting the primary photons.");
+    fMessenger->DeclareMethodWithUnit("minEnergy", "keV", &PrimaryGeneratorAction::SetMinEnergyCommand,
+                                      "Drop the photon lines below this energy.");
+    fMessenger->DeclareMethodWithUnit("maxEnergy", "keV", &PrimaryGeneratorAction::SetMaxEnergyCommand,
+                                      "Drop the photon lines above this energy.");
+    fMessenger->DeclareMethod("window", &PrimaryGeneratorAction::SetEnergyWindowCommand,
+                              "Sample the lines outside an energy window less often: <min> <max> <unit> [outsideImportance]. "
+                              "The default outside importance is 0.1; 0 drops those lines.");
+    fMessenger->DeclareMethod("clearWindow", &PrimaryGeneratorAction::ClearEnergyWindowCommand,
+                              "Remove the energy window.");
+    fMessenger->DeclareMethod("lineImportance", &PrimaryGeneratorAction::SetLineImportanceCommand,
+                              "Scale the sampling probability of one line: <energy> <unit> <importance>. "
+                              "Primary weights compensate so that tallies stay unbiased.");
+    fMessenger->DeclareMethod("clearLineImportances", &PrimaryGeneratorAction::ClearLineImportancesCommand,
+                              "Remove all line importances.");
+    fMessenger->DeclareMethod("spectrum", &PrimaryGeneratorAction::SetSpectrumCommand,
+                              "Sample energies from a histogram or point-wise spectrum file instead of the nuclide lines. "
+                              "An empty name switches back to the nuclide.");
+    fMessenger->DeclareMethod("angular", &PrimaryGeneratorAction::SetAngularCommand,
+                              "Sample directions from a table of the cosine to the gun direction. "
+                              "With a target volume, the cone sampling is reweighted instead. An empty name switches back to isotropic.");
+}
+
+void PrimaryGeneratorAction::SetNuclideCommand(G4String nuclideName)
+{
+    fPrimary->SetNuclideSource(nuclideName);
+}
+
+void PrimaryGeneratorAction::SetMinEnergyCommand(G4double energy)
+{
+    fPrimary->SetMinPhotonEnergy(energy);
+}
+
+void PrimaryGeneratorAction::SetMaxEnergyCommand(G4double energy)
+{
+    fPrimary->SetMaxPhotonEnergy(energy);
+}
+
+void PrimaryGeneratorAction::SetEnergyWindowCommand(G4String parameters)
+{
+    std::istringstream iss(parameters);
+    G4double windowMin, windowMax;
+    G4String unit;
+    if (!(iss >> windowMin >> windowMax >> unit))
+    {
+        G4cout << "WARNING: window expects <min> <max> <unit> [outsideImportance]\n\n";
+        return;
+    }
+    G4double outsideImportance = .1;
+    iss >> outsideImportance;
+    auto unitValue = G4UIcommand::ValueOf(unit);
+    fPrimary->SetEnergyWindow(windowMin * unitValue, windowMax * unitValue, outsideImportance);
+}
+
+void PrimaryGeneratorAction::ClearEnergyWindowCommand()
+{
+    fPrimary->ClearEnergyWindow();
+}
+
+void PrimaryGeneratorAction::SetLineImportanceCommand(G4String parameters)
+{
+    std::istringstream iss(parameters);
+    G4double energy, importance;
+    G4String unit;
+    if (!(iss >> energy >> unit >> importance))
+    {
+        G4cout << "WARNING: lineImportance expects <energy> <unit> <importance>\n\n";
+        return;
+    }
+    fPrimary->SetLineImportance(energy * G4UIcommand::ValueOf(unit), importance);
+}
+
+void PrimaryGeneratorAction::ClearLineImportancesCommand()
+{
+    fPrimary->ClearLineImportances();
+}
+
+void PrimaryGeneratorAction::SetSpectrumCommand(G4String fileName)
+{
+    fPrimary->SetSpectrumFile(fileName);
+}
+
+void PrimaryGeneratorAction::SetAngularCommand(G4String fileName)
+{
+    fPrimary->SetAngularDistributionFile(fileName);
 }
 
 void PrimaryGeneratorAction::GeneratePrimaries(G4Event *anEvent)
 {
-    fPrimary->SetNuclideSource("Cs-137");
-    fPrimary->SetMinPhotonEnergy(10. * keV);
-    fPrimary->SetSourceVolume("Source");
-    fPrimary->SetTargetVolume("Detector", 5. * cm);
+    StartupProfiler::Instance()->MarkFirstEvent();
+    ThreadProfiler::Instance()->StartEvent();
+
+    // events already tallied in the restored checkpoint stay empty
+    if (CheckpointManager::Instance()->IsSkipped(anEvent->GetEventID()))
+        return;
+
+    auto runID = G4RunManager::GetRunManager()->GetCurrentRun()->GetRunID();
+    EventSeeder::Instance()->SeedEvent(runID, anEvent->GetEventID());
+
+    if (fPhaseSpace->IsActive())
+    {
+        fPhaseSpace->GeneratePrimaryVertex(anEvent);
+        return;
+    }
+
+    // the volumes and the response grid are set once per run, before any pipeline producer samples the source
+    if (runID != fRunID)
+    {
+        fPrimary->SetSourceVolume("Source");
+        fPrimary->SetTargetVolume("Detector", 5. * cm);
+        const auto &incidentEnergies = ResponseMatrix::Instance()->GetIncidentEnergies();
+        if (incidentEnergies != fPrimary->GetEnergyGrid())
+            fPrimary->SetEnergyGrid(incidentEnergies);
+        fRunID = runID;
+    }
 
-    fPrimary->GeneratePrimaryVertex(anEvent);
+    fPrimary->PrepareSampling();
+    auto sample = fPrimary->GetDefaultSample();
+    // a pre-sampled primary comes with the engine state after its sampling, so both paths give the same event
+    auto pipeline = PrimaryPipeline::Instance();
+    if (!pipeline->IsRunning() || !pipeline->Pop(fPrimary, anEvent->GetEventID(), sample))
+        fPrimary->SamplePrimary(sample);
+    fPrimary->GeneratePrimaryVertex(anEvent, sample);
+    PointDetectorEstimator::Instance()->ScoreEmission(*fPrimary, sample);
 }
@@ -0,0 +1,233 @@
+#include "G4AutoLock.hh"
+#include "G4GenericMessenger.hh"
+#include "G4UIcommand.hh"
+#include "G4ios.hh"
+#include "CLHEP/Random/EngineFactory.h"
+
+#include "PrimaryPipeline.hh"
+#include "EventSeeder.hh"
+
+#include <chrono>
+
+PrimaryPipeline *PrimaryPipeline::fInstance = nullptr;
+#ifdef G4MULTITHREADED
+G4Mutex PrimaryPipeline::PrimaryPipelineMutex = G4MUTEX_INITIALIZER;
+#endif
+
+namespace
+{
+    // yields of a worker waiting for its block before it waits for a producer
+    constexpr G4int kSpinLimit = 64;
+} // namespace
+
+PrimaryPipeline *PrimaryPipeline::Instance()
+{
+    if (fInstance == nullptr)
+    {
+#ifdef G4MULTITHREADED
+        G4MUTEXLOCK(&PrimaryPipelineMutex);
+        if (fInstance == nullptr)
+        {
+#endif
+            fInstance = new PrimaryPipeline;
+#ifdef G4MULTITHREADED
+        }
+        G4MUTEXUNLOCK(&PrimaryPipelineMutex);
+#endif
+    }
+
+    return fInstance;
+}
+
+PrimaryPipeline::PrimaryPipeline()
+    : fNumberOfProducers(0), fDepth(64), fRunID(0), fFirstEventID(0), fNumberOfEvents(0), fNumberOfBlocks(0),
+      fNextBlock(0), fGun(nullptr), fRunning(false), fNumberOfWaiting(0), fStalls(0)
+{
+    fMessenger = new G4GenericMessenger(this, "/advpg/pipeline/", "Asynchronous primary pre-generation");
+
+    auto &producersCmd = fMessenger->DeclareProperty("producers", fNumberOfProducers,
+                                                     "Number of producer threads pre-sampling primaries (0 disables the pipeline; needs -s).");
+    producersCmd.SetParameterName("nProducers", false).SetRange("nProducers>=0");
+    producersCmd.SetStates(G4State_PreInit, G4State_Idle);
+    producersCmd.command->SetToBeBroadcasted(false);
+
+    auto &depthCmd = fMessenger->DeclareProperty("depth", fDepth,
+                                                 "Number of blocks of pre-sampled primaries buffered ahead of the workers.");
+    depthCmd.SetParameterName("nBlocks", false).SetRange("nBlocks>=2");
+    depthCmd.SetStates(G4State_PreInit, G4State_Idle);
+    depthCmd.command->SetToBeBroadcasted(false);
+}
+
+PrimaryPipeline::~PrimaryPipeline()
+{
+    Stop();
+    delete fMessenger;
+    fInstance = nullptr;
+}
+
+void PrimaryPipeline::Start(G4int runID, G4int firstEventID, G4int numberOfEvents)
+{
+    if (!IsEnabled() || fRunning || numberOfEvents <= 0)
+        return;
+    if (!EventSeeder::Instance()->IsEnabled())
+    {
+        G4cout << "WARNING: The primary pipeline needs per-event random streams (-s); it is not started.\n\n";
+        return;
+    }
+
+    fRunID = runID;
+    fFirstEventID = firstEventID;
+    fNumberOfEvents = numberOfEvents;
+    fNumberOfBlocks = (numberOfEvents + PrimaryBlock::kSize - 1) / PrimaryBlock::kSize;
+    fSlots.reset(new Slot[fDepth]);
+    for (G4int i = 0; i < fDepth; ++i)
+    {
+        fSlots[i].fFreeFor = i;
+        fSlots[i].fReadyBlock = -1;
+        fSlots[i].fNumberOfPopped = 0;
+    }
+    fNextBlock = 0;
+    fGun = nullptr;
+    fStalls = 0;
+
+    // engines of the type of the event loop, so that the workers can continue their states
+    fEngines.clear();
+    auto state = G4Random::getTheEngine()->put();
+    for (G4int i = 0; i < fNumberOfProducers; ++i)
+        fEngines.emplace_back(CLHEP::EngineFactory::newEngine(state));
+
+    fRunning = true;
+    for (G4int i = 0; i < fNumberOfProducers; ++i)
+        fProducers.emplace_back(&PrimaryPipeline::Produce, this, i);
+}
+
+void PrimaryPipeline::Stop()
+{
+    if (!fRunning)
+        return;
+
+    fRunning = false;
+    for (auto &producer : fProducers)
+        producer.join();
+    fProducers.clear();
+
+    G4cout << "Primary pipeline: " << fNumberOfProducers << " producers, depth " << fDepth
+           << " blocks of " << PrimaryBlock::kSize << " primaries, produced "
+           << std::min(fNextBlock.load(), fNumberOfBlocks) << "/" << fNumberOfBlocks
+           << " blocks, empty-queue stalls " << fStalls.load() << G4endl;
+}
+
+void PrimaryPipeline::Prepare(AdvancedParticleGun *gun)
+{
+#ifdef G4MULTITHREADED
+    G4AutoLock lock(&PrimaryPipelineMutex);
+#endif
+    if (fGun.load())
+        return;
+
+    // the gun only changes between runs, so the producers may read it for the whole run
+    gun->PrepareSampling();
+    fDefaultSample = gun->GetDefaultSample();
+    fGun.store(gun, std::memory_order_release);
+}
+
+G4bool PrimaryPipeline::Pop(AdvancedParticleGun *gun, G4int eventID, PrimarySample &sample)
+{
+    if (eventID < fFirstEventID || eventID >= fFirstEventID + fNumberOfEvents)
+        return false;
+    if (!fGun.load(std::memory_order_acquire))
+        Prepare(gun);
+
+    // events are handed to the workers in increasing order, so the lowest pending block is always being filled
+    std::int64_t block = (eventID - fFirstEventID) / PrimaryBlock::kSize;
+    auto &slot = fSlots[block % fDepth];
+    if (slot.fReadyBlock.load(std::memory_order_acquire) != block)
+    {
+        ++fStalls;
+        for (G4int spin = 0; slot.fReadyBlock.load(std::memory_order_acquire) != block; ++spin)
+        {
+            if (!fRunning.load(std::memory_order_acquire))
+                return false;
+            if (spin < kSpinLimit)
+                std::this_thread::yield();
+            else
+            {
+                // the timeout bounds a missed signal and notices the end of the run
+                std::unique_lock<std::mutex> lock(fMutex);
+                ++fNumberOfWaiting;
+                fFilled.wait_for(lock, std::chrono::milliseconds(1), [&slot, block]
+                                 { return slot.fReadyBlock.load() == block; });
+                --fNumberOfWaiting;
+            }
+        }
+    }
+
+    auto i = static_cast<G4int>(eventID - fFirstEventID - block * PrimaryBlock::kSize);
+    const auto &primaries = slot.fBlock;
+    sample.fPosition.set(primaries.fX[i], primaries.fY[i], primaries.fZ[i]);
+    sample.fDirection.set(primaries.fU[i], primaries.fV[i], primaries.fW[i]);
+    sample.fEnergy = primaries.fEnergy[i];
+    sample.fWeight = primaries.fWeight[i];
+    sample.fEmissionWeight = primaries.fEmissionWeight[i];
+    auto restored = G4Random::getTheEngine()->get(primaries.fEngineStates[i]);
+
+    // the last event of a block frees its slot for the block depth blocks ahead
+    if (slot.fNumberOfPopped.fetch_add(1, std::memory_order_acq_rel) + 1 == GetNumberOfEvents(block))
+    {
+        slot.fNumberOfPopped.store(0, std::memory_order_relaxed);
+        slot.fFreeFor.store(block + fDepth, std::memory_order_release);
+    }
+
+    if (!restored)
+        G4cerr << "WARNING: Pre-sampled engine state of event " << eventID << " not restored; sampling the primary again.\n";
+    return restored;
+}
+
+void PrimaryPipeline::Produce(G4int producerID)
+{
+    G4Random::setTheEngine(fEngines[producerID].get());
+    while (fRunning.load(std::memory_order_acquire))
+    {
+        const auto gun = fGun.load(std::memory_order_acquire);
+        auto block = fNextBlock.load(std::memory_order_acquire);
+        if (!gun || block >= fNumberOfBlocks || fSlots[block % fDepth].fFreeFor.load(std::memory_order_acquire) != block)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            continue;
+        }
+        if (fNextBlock.compare_exchange_weak(block, block + 1, std::memory_order_acq_rel))
+            Fill(block, gun);
+    }
+}
+
+void PrimaryPipeline::Fill(std::int64_t block, const AdvancedParticleGun *gun)
+{
+    auto seeder = EventSeeder::Instance();
+    auto &slot = fSlots[block % fDepth];
+    auto &primaries = slot.fBlock;
+    auto firstEventID = fFirstEventID + static_cast<G4int>(block * PrimaryBlock::kSize);
+    for (G4int i = 0; i < GetNumberOfEvents(block); ++i)
+    {
+        // as GeneratePrimaries() does without the pipeline
+        seeder->SeedEvent(fRunID, firstEventID + i);
+        auto sample = fDefaultSample;
+        gun->SamplePrimary(sample);
+        primaries.fX[i] = sample.fPosition.x();
+        primaries.fY[i] = sample.fPosition.y();
+        primaries.fZ[i] = sample.fPosition.z();
+        primaries.fU[i] = sample.fDirection.x();
+        primaries.fV[i] = sample.fDirection.y();
+        primaries.fW[i] = sample.fDirection.z();
+        primaries.fEnergy[i] = sample.fEnergy;
+        primaries.fWeight[i] = sample.fWeight;
+        primaries.fEmissionWeight[i] = sample.fEmissionWeight;
+        primaries.fEngineStates[i] = G4Random::getTheEngine()->put();
+    }
+
+    slot.fReadyBlock.store(block, std::memory_order_release);
+    if (fNumberOfWaiting.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fFilled.notify_all();
+    }
+}
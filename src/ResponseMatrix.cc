@@ -0,0 +1,296 @@
+#include "G4AutoLock.hh"
+#include "G4Event.hh"
+#include "G4GenericMessenger.hh"
+#include "G4PrimaryParticle.hh"
+#include "G4PrimaryVertex.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4UIcommand.hh"
+#include "G4ios.hh"
+
+#include "ResponseMatrix.hh"
+#include "ICRP07Manager.hh"
+#include "ShardManager.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+ResponseMatrix *ResponseMatrix::fInstance = nullptr;
+G4ThreadLocal ResponseMatrix::Tally *ResponseMatrix::fThreadTally = nullptr;
+#ifdef G4MULTITHREADED
+G4Mutex ResponseMatrix::ResponseMatrixMutex = G4MUTEX_INITIALIZER;
+#endif
+
+ResponseMatrix *ResponseMatrix::Instance()
+{
+    if (fInstance == nullptr)
+    {
+#ifdef G4MULTITHREADED
+        G4MUTEXLOCK(&ResponseMatrixMutex);
+        if (fInstance == nullptr)
+        {
+#endif
+            fInstance = new ResponseMatrix;
+#ifdef G4MULTITHREADED
+        }
+        G4MUTEXUNLOCK(&ResponseMatrixMutex);
+#endif
+    }
+
+    return fInstance;
+}
+
+ResponseMatrix::ResponseMatrix()
+    : fNumberOfDepositBins(1024), fMaxDeposit(3. * MeV), fFileName("Response")
+{
+    fMessenger = new G4GenericMessenger(this, "/advpg/response/", "Detector response matrix");
+
+    // the guns take the grid at their first event of every run, before any primary is sampled
+    auto &gridCmd = fMessenger->DeclareMethod("grid", &ResponseMatrix::SetGridCommand,
+                                              "Sample the primaries over a logarithmic grid of incident energies: <min> <max> <n> <unit>.");
+    gridCmd.SetStates(G4State_PreInit, G4State_Idle);
+    gridCmd.command->SetToBeBroadcasted(false);
+
+    auto &linesCmd = fMessenger->DeclareMethod("lines", &ResponseMatrix::SetLinesCommand,
+                                               "Sample the primaries over the photon lines of all ICRP 107 nuclides: <min> <max> <unit> [mergeWidth]. "
+                                               "Lines closer than the merge width (default one deposit bin) share a grid energy.");
+    linesCmd.SetStates(G4State_PreInit, G4State_Idle);
+    linesCmd.command->SetToBeBroadcasted(false);
+
+    auto &clearCmd = fMessenger->DeclareMethod("clear", &ResponseMatrix::Clear,
+                                               "Remove the grid, i.e. go back to the nuclide source.");
+    clearCmd.SetStates(G4State_PreInit, G4State_Idle);
+    clearCmd.command->SetToBeBroadcasted(false);
+
+    auto &depositCmd = fMessenger->DeclareMethod("deposit", &ResponseMatrix::SetDepositCommand,
+                                                 "Deposited-energy binning: <nBins> <max> <unit> (default 1024 bins up to 3 MeV).");
+    depositCmd.SetStates(G4State_PreInit, G4State_Idle);
+    depositCmd.command->SetToBeBroadcasted(false);
+
+    auto &fileCmd = fMessenger->DeclareProperty("file", fFileName,
+                                                "Base name of the response matrix file (.dat is appended).");
+    fileCmd.SetStates(G4State_PreInit, G4State_Idle);
+    fileCmd.command->SetToBeBroadcasted(false);
+}
+
+ResponseMatrix::~ResponseMatrix()
+{
+    delete fMessenger;
+    fInstance = nullptr;
+}
+
+void ResponseMatrix::Tally::Reset(std::size_t numberOfIncidentEnergies, std::size_t numberOfDepositBins)
+{
+    fSumWeights.assign(numberOfIncidentEnergies * numberOfDepositBins, 0.);
+    fSumWeights2.assign(numberOfIncidentEnergies * numberOfDepositBins, 0.);
+    fNumberOfHistories.assign(numberOfIncidentEnergies, 0);
+}
+
+void ResponseMatrix::SetGridCommand(G4String parameters)
+{
+    std::istringstream iss(parameters);
+    G4double minEnergy, maxEnergy;
+    G4int n;
+    G4String unit;
+    if (!(iss >> minEnergy >> maxEnergy >> n >> unit) || minEnergy <= 0. || maxEnergy <= minEnergy || n < 2)
+    {
+        G4cerr << "WARNING: grid expects <min> <max> <n> <unit> with 0 < min < max and n > 1.\n";
+        return;
+    }
+
+    fIncidentEnergies.clear();
+    for (G4int i = 0; i < n; ++i)
+        fIncidentEnergies.push_back(minEnergy * std::pow(maxEnergy / minEnergy, static_cast<G4double>(i) / (n - 1)) * G4UIcommand::ValueOf(unit));
+}
+
+void ResponseMatrix::SetLinesCommand(G4String parameters)
+{
+    std::istringstream iss(parameters);
+    G4double minEnergy, maxEnergy;
+    G4String unit;
+    if (!(iss >> minEnergy >> maxEnergy >> unit) || maxEnergy <= minEnergy)
+    {
+        G4cerr << "WARNING: lines expects <min> <max> <unit> [mergeWidth].\n";
+        return;
+    }
+    auto unitValue = G4UIcommand::ValueOf(unit);
+    G4double mergeWidth;
+    if (iss >> mergeWidth)
+        mergeWidth *= unitValue;
+    else
+        mergeWidth = fMaxDeposit / fNumberOfDepositBins;
+
+    // each group of lines spanning less than the merge width is represented by its centre
+    fIncidentEnergies.clear();
+    G4double first = -1., last = -1.;
+    for (auto energy : ICRP07Manager::Instance()->GetPhotonEnergies())
+    {
+        if (energy < minEnergy * unitValue || energy > maxEnergy * unitValue)
+            continue;
+        if (first >= 0. && energy - first >= mergeWidth)
+        {
+            fIncidentEnergies.push_back(.5 * (first + last));
+            first = -1.;
+        }
+        if (first < 0.)
+            first = energy;
+        last = energy;
+    }
+    if (first >= 0.)
+        fIncidentEnergies.push_back(.5 * (first + last));
+
+    G4cout << "Response matrix: " << fIncidentEnergies.size() << " incident energies from the ICRP 107 lines" << G4endl;
+}
+
+void ResponseMatrix::SetDepositCommand(G4String parameters)
+{
+    std::istringstream iss(parameters);
+    G4int nBins;
+    G4double maxDeposit;
+    G4String unit;
+    if (!(iss >> nBins >> maxDeposit >> unit) || nBins < 1 || maxDeposit <= 0.)
+    {
+        G4cerr << "WARNING: deposit expects <nBins> <max> <unit>.\n";
+        return;
+    }
+
+    fNumberOfDepositBins = nBins;
+    fMaxDeposit = maxDeposit * G4UIcommand::ValueOf(unit);
+}
+
+void ResponseMatrix::Clear()
+{
+    fIncidentEnergies.clear();
+}
+
+void ResponseMatrix::BeginOfRun()
+{
+    fTotal.Reset(fIncidentEnergies.size(), fNumberOfDepositBins);
+}
+
+void ResponseMatrix::BeginOfWorkerRun()
+{
+    if (!IsEnabled())
+        return;
+
+    if (!fThreadTally)
+        fThreadTally = new Tally;
+    fThreadTally->Reset(fIncidentEnergies.size(), fNumberOfDepositBins);
+}
+
+G4int ResponseMatrix::GetIncidentIndex(const G4Event *event) const
+{
+    if (!IsEnabled() || !event->GetPrimaryVertex())
+        return -1;
+
+    // the guns sample the grid energies exactly
+    auto energy = event->GetPrimaryVertex()->GetPrimary()->GetKineticEnergy();
+    auto iter = std::lower_bound(fIncidentEnergies.begin(), fIncidentEnergies.end(), energy * (1. - 1e-9));
+    if (iter == fIncidentEnergies.end() || *iter > energy * (1. + 1e-9))
+        return -1;
+
+    return static_cast<G4int>(iter - fIncidentEnergies.begin());
+}
+
+void ResponseMatrix::Fill(G4int incident, G4double eDep, G4double weight)
+{
+    if (incident < 0 || eDep < 0. || eDep >= fMaxDeposit)
+        return;
+
+    auto bin = std::min(static_cast<G4int>(eDep / fMaxDeposit * fNumberOfDepositBins), fNumberOfDepositBins - 1);
+    auto cell = static_cast<std::size_t>(incident) * fNumberOfDepositBins + bin;
+    fThreadTally->fSumWeights[cell] += weight;
+    fThreadTally->fSumWeights2[cell] += weight * weight;
+}
+
+void ResponseMatrix::EndOfEvent(G4int incident)
+{
+    if (incident < 0)
+        return;
+
+    ++fThreadTally->fNumberOfHistories[incident];
+}
+
+void ResponseMatrix::EndOfWorkerRun()
+{
+    if (!IsEnabled())
+        return;
+
+#ifdef G4MULTITHREADED
+    G4AutoLock lock(&ResponseMatrixMutex);
+#endif
+    for (std::size_t cell = 0; cell < fTotal.fSumWeights.size(); ++cell)
+    {
+        fTotal.fSumWeights[cell] += fThreadTally->fSumWeights[cell];
+        fTotal.fSumWeights2[cell] += fThreadTally->fSumWeights2[cell];
+    }
+    for (std::size_t i = 0; i < fTotal.fNumberOfHistories.size(); ++i)
+        fTotal.fNumberOfHistories[i] += fThreadTally->fNumberOfHistories[i];
+}
+
+void ResponseMatrix::GetThreadTallies(std::vector<G4double> &tallies) const
+{
+    tallies.clear();
+    if (!IsEnabled() || !fThreadTally)
+        return;
+
+    tallies = fThreadTally->fSumWeights;
+    tallies.insert(tallies.end(), fThreadTally->fSumWeights2.begin(), fThreadTally->fSumWeights2.end());
+    tallies.insert(tallies.end(), fThreadTally->fNumberOfHistories.begin(), fThreadTally->fNumberOfHistories.end());
+}
+
+G4bool ResponseMatrix::AddTallies(const std::vector<G4double> &tallies)
+{
+    if (tallies.empty())
+        return true;
+    auto nCells = fTotal.fSumWeights.size();
+    if (!IsEnabled() || tallies.size() != 2 * nCells + fTotal.fNumberOfHistories.size())
+        return false;
+
+    auto value = tallies.begin();
+    for (std::size_t cell = 0; cell < nCells; ++cell)
+        fTotal.fSumWeights[cell] += *value++;
+    for (std::size_t cell = 0; cell < nCells; ++cell)
+        fTotal.fSumWeights2[cell] += *value++;
+    for (auto &nHistories : fTotal.fNumberOfHistories)
+        nHistories += static_cast<std::uint64_t>(*value++);
+    return true;
+}
+
+void ResponseMatrix::EndOfRun() const
+{
+    if (!IsEnabled())
+        return;
+
+    auto fileName = ShardManager::Instance()->GetOutputName(fFileName) + ".dat";
+    std::ofstream ofs(fileName.c_str());
+    if (!ofs.is_open())
+    {
+        G4cerr << "WARNING: Cannot write " << fileName << ".\n";
+        return;
+    }
+
+    // only the non-empty cells are written; energies in MeV
+    ofs << "# example_advpg response matrix, energies in MeV\n"
+        << "# incident <index> <energy> <histories>\n"
+        << "# cell <index> <deposit bin> <sum of weights> <sum of squared weights>\n";
+    ofs.precision(std::numeric_limits<G4double>::max_digits10);
+    ofs << "deposit " << fNumberOfDepositBins << " " << fMaxDeposit / MeV << "\n";
+    std::uint64_t nHistories = 0;
+    for (std::size_t i = 0; i < fIncidentEnergies.size(); ++i)
+    {
+        ofs << "incident " << i << " " << fIncidentEnergies[i] / MeV << " " << fTotal.fNumberOfHistories[i] << "\n";
+        nHistories += fTotal.fNumberOfHistories[i];
+    }
+    for (std::size_t cell = 0; cell < fTotal.fSumWeights.size(); ++cell)
+    {
+        if (fTotal.fSumWeights[cell] > 0.)
+            ofs << "cell " << cell / fNumberOfDepositBins << " " << cell % fNumberOfDepositBins << " "
+                << fTotal.fSumWeights[cell] << " " << fTotal.fSumWeights2[cell] << "\n";
+    }
+
+    G4cout << "Response matrix: " << fIncidentEnergies.size() << " incident energies x " << fNumberOfDepositBins
+           << " deposit bins, " << nHistories << " histories written to " << fileName << G4endl;
+}
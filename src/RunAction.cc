@@ -1,41 +1,184 @@
+#include "G4AccumulableManager.hh"
 #include "G4RunManager.hh"
+#include "G4Run.hh"
 #include "G4SystemOfUnits.hh"
 #include "g4csv.hh"
 
 #include "RunAction.hh"
+#include "PhaseSpaceWriter.hh"
+#include "PrimaryPipeline.hh"
+#include "EventSeeder.hh"
+#include "ShardManager.hh"
+#include "CheckpointManager.hh"
+#include "VarianceReduction.hh"
+#include "PhysicsTableCache.hh"
+#include "ThreadProfiler.hh"
+#include "PointDetectorEstimator.hh"
+#include "ResponseMatrix.hh"
+
+#include <algorithm>
+#include <cmath>
 
 RunAction::RunAction()
-    : G4UserRunAction()
+    : G4UserRunAction(), fSumTally(0.), fSumTally2(0.)
 {
+    auto accumulableManager = G4AccumulableManager::Instance();
+    accumulableManager->RegisterAccumulable(fSumTally);
+    accumulableManager->RegisterAccumulable(fSumTally2);
+
     auto analysisManager = G4AnalysisManager::Instance();
 
     analysisManager->CreateH1("EDep", "Energy Deposition", 1024, 0., 3. * MeV);
+    analysisManager->CreateH1("EDepRes", "Energy Deposition with Detector Resolution", 1024, 0., 3. * MeV);
 
     analysisManager->CreateNtuple("EDep", "Energy Deposition");
     analysisManager->CreateNtupleIColumn("EvtID");
     analysisManager->CreateNtupleDColumn("E(MeV)");
     analysisManager->CreateNtupleDColumn("Weight");
+    // with the event ID, they identify the event across runs and shards
+    analysisManager->CreateNtupleIColumn("Run");
+    analysisManager->CreateNtupleIColumn("Shard");
     analysisManager->FinishNtuple();
+
+    PhaseSpaceWriter::Instance();
+    if (G4Threading::IsMasterThread())
+    {
+        PrimaryPipeline::Instance();
+        EventSeeder::Instance();
+        CheckpointManager::Instance();
+        VarianceReduction::Instance();
+        ThreadProfiler::Instance();
+        PointDetectorEstimator::Instance();
+        ResponseMatrix::Instance();
+    }
 }
 
 RunAction::~RunAction()
 {
     delete G4AnalysisManager::Instance();
+    delete PhaseSpaceWriter::Instance();
+    if (G4Threading::IsMasterThread())
+    {
+        delete PrimaryPipeline::Instance();
+        delete EventSeeder::Instance();
+        delete CheckpointManager::Instance();
+        delete VarianceReduction::Instance();
+        delete ThreadProfiler::Instance();
+        delete PointDetectorEstimator::Instance();
+        delete ResponseMatrix::Instance();
+    }
+}
+
+G4bool RunAction::IsEventLoopThread() const
+{
+    return !IsMaster() || G4RunManager::GetRunManager()->GetRunManagerType() == G4RunManager::sequentialRM;
 }
 
-void RunAction::BeginOfRunAction(const G4Run *)
+void RunAction::BeginOfRunAction(const G4Run *run)
 {
     G4RunManager::GetRunManager()->SetPrintProgress(static_cast<G4int>(G4RunManager::GetRunManager()->GetNumberOfEventsToBeProcessed() * .1));
 
+    G4AccumulableManager::Instance()->Reset();
+
     auto analysisManager = G4AnalysisManager::Instance();
 
-    analysisManager->OpenFile("Result");
+    auto shardManager = ShardManager::Instance();
+    auto outputName = shardManager->GetOutputName("Result");
+
+    if (IsMaster())
+    {
+        EventSeeder::Instance()->SetFirstEvent(shardManager->GetFirstEvent(run->GetNumberOfEventToBeProcessed()));
+        CheckpointManager::Instance()->BeginOfRun(run->GetNumberOfEventToBeProcessed(),
+                                                  IsEventLoopThread() ? 1 : G4RunManager::GetRunManager()->GetNumberOfThreads());
+        // events skipped by a resumed run are not pre-sampled
+        auto nSkipped = CheckpointManager::Instance()->GetNumberOfSkippedEvents();
+        PrimaryPipeline::Instance()->Start(run->GetRunID(), nSkipped, run->GetNumberOfEventToBeProcessed() - nSkipped);
+        // before any thread reopens (and truncates) the ntuple files of a resumed run
+        CheckpointManager::Instance()->PreserveNtuples(outputName);
+        VarianceReduction::Instance()->Prepare();
+        PointDetectorEstimator::Instance()->BeginOfRun();
+        ResponseMatrix::Instance()->BeginOfRun();
+        fTimer.Start();
+    }
+
+    analysisManager->OpenFile(outputName);
+
+    if (IsEventLoopThread())
+    {
+        PhaseSpaceWriter::Instance()->Open();
+        CheckpointManager::Instance()->BeginOfWorkerRun();
+        ThreadProfiler::Instance()->BeginOfRun();
+        PointDetectorEstimator::Instance()->BeginOfWorkerRun();
+        ResponseMatrix::Instance()->BeginOfWorkerRun();
+    }
 }
 
-void RunAction::EndOfRunAction(const G4Run *)
+void RunAction::EndOfRunAction(const G4Run *run)
 {
+    // restored tallies of a resumed run go into the merged master histograms
+    if (IsMaster())
+        CheckpointManager::Instance()->EndOfRun();
+
     auto analysisManager = G4AnalysisManager::Instance();
 
     analysisManager->Write();
     analysisManager->CloseFile();
+
+    if (IsMaster())
+        CheckpointManager::Instance()->RestoreNtuples();
+
+    if (IsEventLoopThread())
+    {
+        PhaseSpaceWriter::Instance()->Close(run->GetNumberOfEvent());
+        ThreadProfiler::Instance()->PrintThread();
+        PointDetectorEstimator::Instance()->EndOfWorkerRun();
+        ResponseMatrix::Instance()->EndOfWorkerRun();
+    }
+    else
+        PhaseSpaceWriter::Instance()->Merge(G4RunManager::GetRunManager()->GetNumberOfThreads());
+
+    G4AccumulableManager::Instance()->Merge();
+
+    if (IsMaster())
+    {
+        PrimaryPipeline::Instance()->Stop();
+        PhysicsTableCache::Instance()->Store();
+        fTimer.Stop();
+        PrintEfficiency(run);
+        PointDetectorEstimator::Instance()->EndOfRun();
+        // a matrix without any fills is not written
+        if (VarianceReduction::Instance()->IsScoringPulseHeights())
+            ResponseMatrix::Instance()->EndOfRun();
+        ThreadProfiler::Instance()->PrintRun(IsEventLoopThread() ? 1 : G4RunManager::GetRunManager()->GetNumberOfThreads(),
+                                             run->GetNumberOfEvent(), fTimer.GetRealElapsed());
+    }
+}
+
+void RunAction::PrintEfficiency(const G4Run *run) const
+{
+    // events restored from a checkpoint were skipped by this run, but their tallies and time are included
+    auto checkpointManager = CheckpointManager::Instance();
+    auto nSimulated = run->GetNumberOfEvent() - checkpointManager->GetNumberOfSkippedEvents();
+    auto nEvents = static_cast<G4double>(nSimulated) + static_cast<G4double>(checkpointManager->GetNumberOfRestoredEvents());
+    auto sumTally = fSumTally.GetValue();
+    auto runTime = fTimer.GetRealElapsed();
+    auto time = runTime + checkpointManager->GetRestoredTime();
+    if (nEvents == 0. || sumTally <= 0. || time <= 0.)
+        return;
+
+    // R^2 = sum(x^2) / sum(x)^2 - 1/N and FOM = 1 / (R^2 T)
+    auto relativeError2 = fSumTally2.GetValue() / (sumTally * sumTally) - 1. / nEvents;
+    auto fom = (relativeError2 > 0.) ? 1. / (relativeError2 * time) : 0.;
+
+    auto vr = VarianceReduction::Instance();
+    G4cout << "Efficiency: " << nSimulated << " events in " << runTime << " s ("
+           << (runTime > 0. ? nSimulated / runTime : 0.) << " events/s)";
+    if (nEvents > nSimulated)
+        G4cout << ", " << nEvents << " events in " << time << " s with the restored ones";
+    G4cout << ", relative error " << std::sqrt(std::max(relativeError2, 0.))
+           << ", FOM " << fom << " /s" << G4endl;
+    if (!vr->IsEnabled())
+        vr->SetAnalogFOM(fom);
+    else if (vr->GetAnalogFOM() > 0.)
+        G4cout << " -- FOM gain over the analog run: " << fom / vr->GetAnalogFOM() << G4endl;
 }
@@ -0,0 +1,622 @@
+#include "G4Box.hh"
+#include "G4LogicalVolume.hh"
+#include "G4NistManager.hh"
+#include "G4Orb.hh"
+#include "G4PVPlacement.hh"
+#include "G4PhysicalConstants.hh"
+#include "G4PhysicalVolumeStore.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4Trd.hh"
+#include "G4Tubs.hh"
+#include "G4ios.hh"
+#include "Randomize.hh"
+
+#include "SamplerValidation.hh"
+#include "AdvancedParticleGun.hh"
+#include "ICRP07Manager.hh"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <map>
+
+namespace
+{
+    // a failing check is one that a correct sampler fails with a probability below this
+    const G4double kMinimumPValue = 1e-4;
+    const long kSeed = 20240917;
+
+    G4LogicalVolume *gWorldLV = nullptr;
+
+    G4VPhysicalVolume *Place(G4VSolid *solid, G4RotationMatrix *rotation, const G4ThreeVector &translation,
+                             G4LogicalVolume *motherLV)
+    {
+        // AdvancedParticleGun finds mothers by the name of their logical volume
+        auto lv = new G4LogicalVolume(solid, G4NistManager::Instance()->FindOrBuildMaterial("G4_AIR"), solid->GetName());
+        return new G4PVPlacement(rotation, translation, lv, solid->GetName(), motherLV, false, 0);
+    }
+
+    // A parent and a daughter with a line below the 10 keV cutoff, a line shared by
+    // both and a rare line, so that the line sampling is checked without the ICRP 107 files.
+    void AddSyntheticNuclides()
+    {
+        DecayData parentDecay{"1y", "B-", {"Synthetic-2"}, {.8}};
+        RadiationData parentLines{{5. * keV, 60. * keV, 300. * keV, 662. * keV, 1173. * keV},
+                                  {.2, .3, .05, .85, .999}};
+        DecayData daughterDecay{"1d", "IT", {}, {}};
+        RadiationData daughterLines{{662. * keV, 1332. * keV, 2000. * keV}, {.1, 1., .002}};
+
+        auto icrp107 = ICRP07Manager::Instance();
+        icrp107->AddNuclide("Synthetic-1", parentDecay, parentLines);
+        icrp107->AddNuclide("Synthetic-2", daughterDecay, daughterLines);
+    }
+} // namespace
+
+int SamplerValidation::Run(G4int numberOfSamples)
+{
+    G4Random::setTheSeed(kSeed);
+
+    auto worldSolid = new G4Box("ValidationWorld", 5. * m, 5. * m, 5. * m);
+    gWorldLV = new G4LogicalVolume(worldSolid, G4NistManager::Instance()->FindOrBuildMaterial("G4_AIR"), "ValidationWorld");
+    new G4PVPlacement(nullptr, G4ThreeVector(), gWorldLV, "ValidationWorld", nullptr, false, 0);
+
+    SamplerValidation validation(numberOfSamples);
+    validation.CheckBox();
+    validation.CheckTubs();
+    validation.CheckOrb();
+    validation.CheckAgainstReference();
+
+    // target box at T, approached obliquely, along +z and -z, and from inside
+    const G4ThreeVector target(0., 0., -2. * m);
+    Place(new G4Box("ValidationTarget", 5. * cm, 5. * cm, 5. * cm), nullptr, target, gWorldLV);
+    validation.CheckCone("cone-oblique", target + G4ThreeVector(-30. * cm, -40. * cm, -50. * cm));
+    validation.CheckCone("cone-plus-z", target - G4ThreeVector(0., 0., 80. * cm));
+    validation.CheckCone("cone-minus-z", target + G4ThreeVector(0., 0., 80. * cm));
+    validation.CheckCone("cone-enclosed", target + G4ThreeVector(1. * cm, 2. * cm, 3. * cm));
+    validation.CheckTabulated(target);
+
+    AddSyntheticNuclides();
+    validation.CheckLines("lines-synthetic", "Synthetic-1", DBL_MAX, 0., DBL_MAX, 1., 1.);
+    validation.CheckLines("lines-synth-window", "Synthetic-1", DBL_MAX, 1. * MeV, 1.5 * MeV, .05, .5);
+    validation.CheckLines("lines-synth-dropped", "Synthetic-1", 1.5 * MeV, 0., DBL_MAX, 1., 0.);
+    validation.CheckLines("lines-Cs-137", "Cs-137", DBL_MAX, 0., DBL_MAX, 1., 1.);
+    validation.CheckLines("lines-Co-60-window", "Co-60", DBL_MAX, 1. * MeV, 1.5 * MeV, .05, .5);
+    validation.CheckLines("lines-Cs-137-dropped", "Cs-137", 100. * keV, 0., DBL_MAX, 1., 0.);
+
+    G4cout << "\nValidation: " << validation.fNumberOfChecks - validation.fNumberOfFailures << " of "
+           << validation.fNumberOfChecks << " checks passed with " << numberOfSamples << " samples each";
+    if (validation.fNumberOfSkipped > 0)
+        G4cout << ", " << validation.fNumberOfSkipped << " configurations skipped";
+    G4cout << G4endl;
+
+    if (validation.fNumberOfFailures > 0)
+        return 1;
+    return (validation.fNumberOfSkipped > 0) ? kSkipped : 0;
+}
+
+SamplerValidation::SamplerValidation(G4int numberOfSamples)
+    : fNumberOfSamples(numberOfSamples), fNumberOfChecks(0), fNumberOfFailures(0), fNumberOfSkipped(0)
+{
+}
+
+void SamplerValidation::CheckBox()
+{
+    // nested and rotated at both levels to exercise the conversion to the world frame
+    auto motherRotation = new G4RotationMatrix;
+    motherRotation->rotateY(20. * deg);
+    auto mother = Place(new G4Box("ValidationMother", 50. * cm, 50. * cm, 50. * cm), motherRotation,
+                        G4ThreeVector(0., 0., 1. * m), gWorldLV);
+
+    const G4ThreeVector halfLength(1. * cm, 2. * cm, 3. * cm);
+    auto rotation = new G4RotationMatrix;
+    rotation->rotateX(30. * deg);
+    rotation->rotateZ(45. * deg);
+    auto pv = Place(new G4Box("ValidationBox", halfLength.x(), halfLength.y(), halfLength.z()), rotation,
+                    G4ThreeVector(10. * cm, -5. * cm, 20. * cm), mother->GetLogicalVolume());
+
+    auto points = SamplePositions(pv);
+    CheckInside("position-box", pv, points);
+    for (G4int axis = 0; axis < 3; ++axis)
+    {
+        std::vector<G4double> values;
+        values.reserve(points.size());
+        for (const auto &point : points)
+            values.push_back(point[axis]);
+        G4String name = G4String("xyz").substr(axis, 1);
+        CheckMean("position-box", "mean-" + name, values, 0., halfLength[axis] * halfLength[axis] / 3.);
+        CheckUniform("position-box", "KS-" + name, values, -halfLength[axis], halfLength[axis]);
+    }
+}
+
+void SamplerValidation::CheckTubs()
+{
+    const G4double rMin = 1. * cm, rMax = 3. * cm, halfZ = 2. * cm, dPhi = 270. * deg;
+    auto rotation = new G4RotationMatrix;
+    rotation->rotateX(90. * deg);
+    auto pv = Place(new G4Tubs("ValidationTubs", rMin, rMax, halfZ, 0., dPhi), rotation,
+                    G4ThreeVector(-1. * m, 0., 0.), gWorldLV);
+
+    auto points = SamplePositions(pv);
+    CheckInside("position-tubs", pv, points);
+
+    std::vector<G4double> radii2, phis, zs;
+    for (const auto &point : points)
+    {
+        radii2.push_back(point.perp2());
+        auto phi = point.phi();
+        phis.push_back((phi < 0.) ? phi + twopi : phi);
+        zs.push_back(point.z());
+    }
+    CheckUniform("position-tubs", "KS-r2", radii2, rMin * rMin, rMax * rMax);
+    CheckUniform("position-tubs", "KS-phi", phis, 0., dPhi);
+    CheckUniform("position-tubs", "KS-z", zs, -halfZ, halfZ);
+}
+
+void SamplerValidation::CheckOrb()
+{
+    const G4double radius = 2. * cm;
+    auto pv = Place(new G4Orb("ValidationOrb", radius), nullptr, G4ThreeVector(1. * m, 0., 0.), gWorldLV);
+
+    auto points = SamplePositions(pv);
+    CheckInside("position-orb", pv, points);
+
+    std::vector<G4double> radii, radii3, cosThetas, phis;
+    for (const auto &point : points)
+    {
+        radii.push_back(point.mag());
+        radii3.push_back(std::pow(point.mag() / radius, 3));
+        cosThetas.push_back(point.cosTheta());
+        phis.push_back(point.phi());
+    }
+    CheckMean("position-orb", "mean-r", radii, .75 * radius, 3. / 80. * radius * radius);
+    CheckUniform("position-orb", "KS-r3", radii3, 0., 1.);
+    CheckUniform("position-orb", "KS-cosTheta", cosThetas, -1., 1.);
+    CheckUniform("position-orb", "KS-phi", phis, -pi, pi);
+}
+
+void SamplerValidation::CheckAgainstReference()
+{
+    // no simple analytic marginals; compare with a plain rejection sampler in the local frame
+    auto rotation = new G4RotationMatrix;
+    rotation->rotateZ(60. * deg);
+    auto solid = new G4Trd("ValidationTrd", 1. * cm, 3. * cm, 2. * cm, .5 * cm, 2. * cm);
+    auto pv = Place(solid, rotation, G4ThreeVector(0., 1. * m, 0.), gWorldLV);
+
+    auto points = SamplePositions(pv);
+    CheckInside("position-trd", pv, points);
+
+    G4ThreeVector boundMin, boundMax;
+    solid->BoundingLimits(boundMin, boundMax);
+    std::vector<G4ThreeVector> referencePoints;
+    referencePoints.reserve(fNumberOfSamples);
+    while (static_cast<G4int>(referencePoints.size()) < fNumberOfSamples)
+    {
+        G4ThreeVector point(boundMin.x() + (boundMax.x() - boundMin.x()) * G4UniformRand(),
+                            boundMin.y() + (boundMax.y() - boundMin.y()) * G4UniformRand(),
+                            boundMin.z() + (boundMax.z() - boundMin.z()) * G4UniformRand());
+        if (solid->Inside(point) == kInside)
+            referencePoints.push_back(point);
+    }
+
+    for (G4int axis = 0; axis < 3; ++axis)
+    {
+        std::vector<G4double> values, reference;
+        for (const auto &point : points)
+            values.push_back(point[axis]);
+        for (const auto &point : referencePoints)
+            reference.push_back(point[axis]);
+        CheckSameDistribution("position-trd", "KS2-" + G4String("xyz").substr(axis, 1), values, reference);
+    }
+}
+
+void SamplerValidation::CheckCone(const G4String &name, const G4ThreeVector &sourcePosition)
+{
+    const G4double margin = 1. * cm;
+    auto targetVol = G4PhysicalVolumeStore::GetInstance()->GetVolume("ValidationTarget");
+
+    // the cone encloses the corners of the target bounding box plus the margin
+    G4ThreeVector boundMin, boundMax;
+    targetVol->GetLogicalVolume()->GetSolid()->BoundingLimits(boundMin, boundMax);
+    auto center = targetVol->GetObjectTranslation();
+    auto axis = center - sourcePosition;
+    auto apexHalfAngle = 0.;
+    for (G4int corner = 0; corner < 8; ++corner)
+    {
+        G4ThreeVector point((corner & 1) ? boundMax.x() + margin : boundMin.x() - margin,
+                            (corner & 2) ? boundMax.y() + margin : boundMin.y() - margin,
+                            (corner & 4) ? boundMax.z() + margin : boundMin.z() - margin);
+        apexHalfAngle = std::max(apexHalfAngle, axis.angle(center + point - sourcePosition));
+    }
+    auto cosApexHalfAngle = std::cos(apexHalfAngle);
+
+    // a source inside the cone apex limit is isotropic and unweighted
+    auto isotropic = cosApexHalfAngle <= 0.;
+    auto expectedWeight = isotropic ? 1. : (1. - cosApexHalfAngle) / 2.;
+    auto cosMin = isotropic ? -1. : cosApexHalfAngle;
+    auto zAxis = isotropic ? G4ThreeVector(0., 0., 1.) : axis.unit();
+    auto xAxis = zAxis.orthogonal().unit();
+    auto yAxis = zAxis.cross(xAxis);
+
+    AdvancedParticleGun gun;
+    gun.SetTargetVolume(targetVol, margin);
+
+    G4int nViolations = 0;
+    std::vector<G4double> cosThetas, phis;
+    cosThetas.reserve(fNumberOfSamples);
+    phis.reserve(fNumberOfSamples);
+    for (G4int i = 0; i < fNumberOfSamples; ++i)
+    {
+        auto sample = gun.GetDefaultSample();
+        sample.fPosition = sourcePosition;
+        gun.SamplePrimary(sample);
+
+        const auto &dir = sample.fDirection;
+        if (std::abs(sample.fWeight - expectedWeight) > 1e-12 * expectedWeight || std::abs(dir.mag() - 1.) > 1e-9)
+            ++nViolations;
+        cosThetas.push_back(dir.dot(zAxis));
+        phis.push_back(std::atan2(dir.dot(yAxis), dir.dot(xAxis)));
+    }
+    Report(name, "weight", nViolations, (nViolations == 0) ? 1. : 0.);
+    CheckMean(name, "mean-cosTheta", cosThetas, (1. + cosMin) / 2., (1. - cosMin) * (1. - cosMin) / 12.);
+    CheckUniform(name, "KS-cosTheta", cosThetas, cosMin, 1.);
+    CheckUniform(name, "KS-phi", phis, -pi, pi);
+}
+
+void SamplerValidation::CheckTabulated(const G4ThreeVector &targetPosition)
+{
+    // histogram spectrum and the angular density p(cos) = (1 + cos) / 2
+    const G4String spectrumFileName = "advpg_validation_spectrum.txt";
+    const G4String angularFileName = "advpg_validation_angular.txt";
+    const std::vector<G4double> edges = {0. * keV, 100. * keV, 200. * keV, 400. * keV};
+    const std::vector<G4double> contents = {1., 3., 4.};
+    std::ofstream spectrumFile(spectrumFileName.c_str());
+    spectrumFile << "histogram\nunit keV\n";
+    for (std::size_t i = 0; i < contents.size(); ++i)
+        spectrumFile << edges[i] / keV << " " << edges[i + 1] / keV << " " << contents[i] << "\n";
+    spectrumFile.close();
+    std::ofstream angularFile(angularFileName.c_str());
+    angularFile << "points\n-1 0\n1 1\n";
+    angularFile.close();
+
+    G4double sumContents = 0., mean = 0., mean2 = 0.;
+    for (const auto &content : contents)
+        sumContents += content;
+    for (std::size_t i = 0; i < contents.size(); ++i)
+    {
+        mean += contents[i] / sumContents * .5 * (edges[i] + edges[i + 1]);
+        mean2 += contents[i] / sumContents * (edges[i] * edges[i] + edges[i] * edges[i + 1] + edges[i + 1] * edges[i + 1]) / 3.;
+    }
+    auto spectrumCDF = [&](G4double energy)
+    {
+        G4double cdf = 0.;
+        for (std::size_t i = 0; i < contents.size(); ++i)
+            cdf += contents[i] / sumContents * std::min(std::max((energy - edges[i]) / (edges[i + 1] - edges[i]), 0.), 1.);
+        return cdf;
+    };
+
+    {
+        // beam along the default gun direction
+        AdvancedParticleGun gun;
+        gun.SetSpectrumFile(spectrumFileName);
+        gun.SetAngularDistributionFile(angularFileName);
+        gun.PrepareSampling();
+
+        auto beamAxis = gun.GetParticleMomentumDirection();
+        auto xAxis = beamAxis.orthogonal().unit();
+        auto yAxis = beamAxis.cross(xAxis);
+        std::vector<G4double> energies, energyCDFs, cosCDFs, phis;
+        for (G4int i = 0; i < fNumberOfSamples; ++i)
+        {
+            auto sample = gun.GetDefaultSample();
+            gun.SamplePrimary(sample);
+            energies.push_back(sample.fEnergy);
+            energyCDFs.push_back(spectrumCDF(sample.fEnergy));
+            auto cosTheta = sample.fDirection.dot(beamAxis);
+            cosCDFs.push_back((1. + cosTheta) * (1. + cosTheta) / 4.);
+            phis.push_back(std::atan2(sample.fDirection.dot(yAxis), sample.fDirection.dot(xAxis)));
+        }
+        CheckMean("tabulated-beam", "mean-energy", energies, mean, mean2 - mean * mean);
+        CheckUniform("tabulated-beam", "KS-energy", energyCDFs, 0., 1.);
+        CheckUniform("tabulated-beam", "KS-cosTheta", cosCDFs, 0., 1.);
+        CheckUniform("tabulated-beam", "KS-phi", phis, -pi, pi);
+    }
+
+    {
+        // beam towards a target along +z: the cone weights carry the emission fraction into the cone
+        const G4double margin = 1. * cm;
+        auto sourcePosition = targetPosition - G4ThreeVector(0., 0., 80. * cm);
+        auto targetVol = G4PhysicalVolumeStore::GetInstance()->GetVolume("ValidationTarget");
+        G4ThreeVector boundMin, boundMax;
+        targetVol->GetLogicalVolume()->GetSolid()->BoundingLimits(boundMin, boundMax);
+        // the nearest corners of the box plus the margin span the cone
+        G4ThreeVector corner(boundMax.x() + margin, boundMax.y() + margin, boundMin.z() - margin);
+        corner += targetPosition - sourcePosition;
+        auto cosApexHalfAngle = std::cos(G4ThreeVector(0., 0., 1.).angle(corner));
+
+        AdvancedParticleGun gun;
+        gun.SetParticleMomentumDirection(G4ThreeVector(0., 0., 1.));
+        gun.SetTargetVolume(targetVol, margin);
+        gun.SetAngularDistributionFile(angularFileName);
+        gun.PrepareSampling();
+
+        std::vector<G4double> weights;
+        for (G4int i = 0; i < fNumberOfSamples; ++i)
+        {
+            auto sample = gun.GetDefaultSample();
+            sample.fPosition = sourcePosition;
+            gun.SamplePrimary(sample);
+            weights.push_back(sample.fWeight);
+        }
+        auto c = cosApexHalfAngle;
+        CheckMean("tabulated-cone", "mean-weight", weights, (1. - c) * (3. + c) / 4., std::pow(1. - c, 4) / 48.);
+    }
+
+    std::remove(spectrumFileName.c_str());
+    std::remove(angularFileName.c_str());
+}
+
+void SamplerValidation::CheckLines(const G4String &name, const G4String &nuclide, G4double maxEnergy,
+                                   G4double windowMin, G4double windowMax, G4double outsideImportance,
+                                   G4double strongestLineImportance)
+{
+    auto icrp107 = ICRP07Manager::Instance();
+    auto photonSource = icrp107->GetPhotonSourceAllDaughters(nuclide);
+    icrp107->RemoveRadiationDataByMinimumEnergy(photonSource, 10. * keV);
+    icrp107->RemoveRadiationDataByMaximumEnergy(photonSource, maxEnergy);
+    if (photonSource.fYields.empty())
+    {
+        G4cout << "VALIDATE " << name << " skipped: no ICRP 107 data for " << nuclide << G4endl;
+        ++fNumberOfSkipped;
+        return;
+    }
+
+    auto strongest = std::max_element(photonSource.fYields.begin(), photonSource.fYields.end()) - photonSource.fYields.begin();
+    auto strongestEnergy = photonSource.fPhotonEnergies[strongest];
+
+    // expected probability and weight per distinct energy, following the documented importance rules
+    std::map<G4double, G4double> probabilities, weights;
+    G4double sumBiasedYield = 0., totalYield = 0., sumYieldOverImportance = 0.;
+    for (std::size_t i = 0; i < photonSource.fYields.size(); ++i)
+    {
+        auto energy = photonSource.fPhotonEnergies[i];
+        auto importance = (energy < windowMin || energy > windowMax) ? outsideImportance : 1.;
+        if (std::abs(strongestEnergy - energy) <= 1e-3 * energy)
+            importance *= strongestLineImportance;
+        if (importance <= 0.)
+            continue;
+        probabilities[energy] += photonSource.fYields[i] * importance;
+        weights[energy] = importance;
+        sumBiasedYield += photonSource.fYields[i] * importance;
+        totalYield += photonSource.fYields[i];
+        sumYieldOverImportance += photonSource.fYields[i] / importance;
+    }
+    for (auto &probability : probabilities)
+        probability.second /= sumBiasedYield;
+    for (auto &weight : weights)
+        weight.second = sumBiasedYield / weight.second;
+
+    AdvancedParticleGun gun;
+    gun.SetNuclideSource(nuclide);
+    gun.SetMinPhotonEnergy(10. * keV);
+    gun.SetMaxPhotonEnergy(maxEnergy);
+    if (windowMax < DBL_MAX)
+        gun.SetEnergyWindow(windowMin, windowMax, outsideImportance);
+    if (strongestLineImportance != 1.)
+        gun.SetLineImportance(strongestEnergy, strongestLineImportance);
+    gun.PrepareSampling();
+
+    G4int nViolations = 0;
+    std::map<G4double, G4int> counts;
+    std::vector<G4double> sampledWeights;
+    sampledWeights.reserve(fNumberOfSamples);
+    for (G4int i = 0; i < fNumberOfSamples; ++i)
+    {
+        auto sample = gun.GetDefaultSample();
+        gun.SamplePrimary(sample);
+
+        auto weight = weights.find(sample.fEnergy);
+        if (weight == weights.end() || std::abs(sample.fWeight - weight->second) > 1e-9 * weight->second)
+            ++nViolations;
+        ++counts[sample.fEnergy];
+        sampledWeights.push_back(sample.fWeight);
+    }
+    Report(name, "weight", nViolations, (nViolations == 0) ? 1. : 0.);
+
+    // lines expecting fewer than 5 counts are pooled into one category
+    G4double chiSquare = 0., pooledExpected = 0., pooledObserved = 0.;
+    G4int nCategories = 0;
+    for (const auto &probability : probabilities)
+    {
+        auto expected = probability.second * fNumberOfSamples;
+        G4double observed = counts[probability.first];
+        if (expected < 5.)
+        {
+            pooledExpected += expected;
+            pooledObserved += observed;
+            continue;
+        }
+        chiSquare += (observed - expected) * (observed - expected) / expected;
+        ++nCategories;
+    }
+    if (pooledExpected > 0.)
+    {
+        chiSquare += (pooledObserved - pooledExpected) * (pooledObserved - pooledExpected) / pooledExpected;
+        ++nCategories;
+    }
+    Report(name, "chi2-lines", chiSquare, (nCategories > 1) ? GetChiSquarePValue(chiSquare, nCategories - 1) : 1.);
+
+    // E[w] is the total yield for any importances
+    CheckMean(name, "mean-weight", sampledWeights, totalYield,
+              sumBiasedYield * sumYieldOverImportance - totalYield * totalYield);
+}
+
+std::vector<G4ThreeVector> SamplerValidation::SamplePositions(G4VPhysicalVolume *pv)
+{
+    AdvancedParticleGun gun;
+    gun.SetSourceVolume(pv);
+
+    std::vector<G4ThreeVector> points;
+    points.reserve(fNumberOfSamples);
+    for (G4int i = 0; i < fNumberOfSamples; ++i)
+    {
+        auto sample = gun.GetDefaultSample();
+        gun.SamplePrimary(sample);
+        points.push_back(ConvertCoordWorld2Volume(pv, sample.fPosition));
+    }
+    return points;
+}
+
+void SamplerValidation::Report(const G4String &name, const G4String &test, G4double statistic, G4double pValue)
+{
+    auto passed = pValue >= kMinimumPValue;
+    ++fNumberOfChecks;
+    if (!passed)
+        ++fNumberOfFailures;
+
+    G4cout << "VALIDATE " << std::left << std::setw(22) << name << std::setw(15) << test << std::right
+           << " stat=" << std::setw(12) << std::setprecision(5) << statistic
+           << " p=" << std::setw(11) << pValue << (passed ? "  PASS" : "  FAIL") << G4endl;
+}
+
+void SamplerValidation::CheckInside(const G4String &name, G4VPhysicalVolume *pv, const std::vector<G4ThreeVector> &points)
+{
+    auto solid = pv->GetLogicalVolume()->GetSolid();
+    G4int nOutside = 0;
+    for (const auto &point : points)
+    {
+        if (solid->Inside(point) == kOutside)
+            ++nOutside;
+    }
+    Report(name, "inside", nOutside, (nOutside == 0) ? 1. : 0.);
+}
+
+void SamplerValidation::CheckUniform(const G4String &name, const G4String &test, std::vector<G4double> values,
+                                     G4double min, G4double max)
+{
+    std::sort(values.begin(), values.end());
+    G4double n = values.size();
+    G4double distance = 0.;
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+        auto cdf = std::min(std::max((values[i] - min) / (max - min), 0.), 1.);
+        distance = std::max(distance, std::max(cdf - i / n, (i + 1) / n - cdf));
+    }
+    Report(name, test, distance, GetKolmogorovPValue(distance, n));
+}
+
+void SamplerValidation::CheckMean(const G4String &name, const G4String &test, const std::vector<G4double> &values,
+                                  G4double mean, G4double variance)
+{
+    G4double sum = 0.;
+    for (const auto &value : values)
+        sum += value;
+    auto difference = sum / values.size() - mean;
+
+    // a vanishing variance (e.g. the weight of an analog source) demands the exact mean
+    G4double z;
+    if (variance > 1e-12 * mean * mean)
+        z = difference / std::sqrt(variance / values.size());
+    else
+        z = (std::abs(difference) <= 1e-9 * std::abs(mean)) ? 0. : DBL_MAX;
+    Report(name, test, z, std::erfc(std::abs(z) / std::sqrt(2.)));
+}
+
+void SamplerValidation::CheckSameDistribution(const G4String &name, const G4String &test, std::vector<G4double> values,
+                                              std::vector<G4double> reference)
+{
+    std::sort(values.begin(), values.end());
+    std::sort(reference.begin(), reference.end());
+    G4double n1 = values.size(), n2 = reference.size();
+    G4double distance = 0.;
+    std::size_t i1 = 0, i2 = 0;
+    while (i1 < values.size() && i2 < reference.size())
+    {
+        auto x = std::min(values[i1], reference[i2]);
+        while (i1 < values.size() && values[i1] <= x)
+            ++i1;
+        while (i2 < reference.size() && reference[i2] <= x)
+            ++i2;
+        distance = std::max(distance, std::abs(i1 / n1 - i2 / n2));
+    }
+    Report(name, test, distance, GetKolmogorovPValue(distance, n1 * n2 / (n1 + n2)));
+}
+
+G4ThreeVector SamplerValidation::ConvertCoordWorld2Volume(const G4VPhysicalVolume *pv, const G4ThreeVector &ptInWorld)
+{
+    // inverse of AdvancedParticleGun::ConvertCoordVolume2World, from the world down to pv
+    std::vector<const G4VPhysicalVolume *> placements;
+    auto currentPV = pv;
+    while (auto lvM = currentPV->GetMotherLogical())
+    {
+        placements.push_back(currentPV);
+        currentPV = G4PhysicalVolumeStore::GetInstance()->GetVolume(lvM->GetName());
+    }
+
+    auto pt = ptInWorld;
+    for (auto placement = placements.rbegin(); placement != placements.rend(); ++placement)
+        pt = (*placement)->GetObjectRotationValue().inverse() * (pt - (*placement)->GetObjectTranslation());
+    return pt;
+}
+
+G4double SamplerValidation::GetChiSquarePValue(G4double chiSquare, G4int degreesOfFreedom)
+{
+    // regularized upper incomplete gamma function Q(k/2, chi2/2)
+    G4double a = .5 * degreesOfFreedom, x = .5 * chiSquare;
+    if (x <= 0.)
+        return 1.;
+    auto prefactor = std::exp(-x + a * std::log(x) - std::lgamma(a));
+
+    if (x < a + 1.)
+    {
+        G4double term = 1. / a, sum = term;
+        for (G4int n = 1; n < 1000 && term > 1e-15 * sum; ++n)
+        {
+            term *= x / (a + n);
+            sum += term;
+        }
+        return std::max(1. - sum * prefactor, 0.);
+    }
+
+    // continued fraction (modified Lentz)
+    const G4double tiny = 1e-300;
+    G4double b = x + 1. - a, c = 1. / tiny, d = 1. / b, h = d;
+    for (G4int i = 1; i < 1000; ++i)
+    {
+        auto an = -i * (i - a);
+        b += 2.;
+        d = an * d + b;
+        if (std::abs(d) < tiny)
+            d = tiny;
+        c = b + an / c;
+        if (std::abs(c) < tiny)
+            c = tiny;
+        d = 1. / d;
+        auto delta = d * c;
+        h *= delta;
+        if (std::abs(delta - 1.) < 1e-15)
+            break;
+    }
+    return prefactor * h;
+}
+
+G4double SamplerValidation::GetKolmogorovPValue(G4double distance, G4double effectiveNumber)
+{
+    auto sqrtN = std::sqrt(effectiveNumber);
+    auto lambda = (sqrtN + .12 + .11 / sqrtN) * distance;
+    if (lambda < .2)
+        return 1.;
+
+    G4double sum = 0., sign = 1.;
+    for (G4int j = 1; j <= 100; ++j)
+    {
+        auto term = sign * std::exp(-2. * j * j * lambda * lambda);
+        sum += term;
+        if (std::abs(term) < 1e-12)
+            break;
+        sign = -sign;
+    }
+    return std::min(std::max(2. * sum, 0.), 1.);
+}
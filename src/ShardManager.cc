@@ -0,0 +1,19 @@
+#include "ShardManager.hh"
+
+ShardManager *ShardManager::Instance()
+{
+    static ShardManager manager;
+    return &manager;
+}
+
+ShardManager::ShardManager()
+    : fShardIndex(0), fNumberOfShards(1)
+{
+}
+
+G4String ShardManager::GetOutputName(const G4String &baseName) const
+{
+    if (!IsSharded())
+        return baseName;
+    return baseName + "_shard" + std::to_string(fShardIndex) + "of" + std::to_string(fNumberOfShards);
+}
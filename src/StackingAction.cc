@@ -0,0 +1,31 @@
+#include "G4Electron.hh"
+#include "G4Track.hh"
+
+#include "StackingAction.hh"
+#include "VarianceReduction.hh"
+
+StackingAction::StackingAction()
+    : G4UserStackingAction()
+{
+}
+
+StackingAction::~StackingAction()
+{
+}
+
+G4ClassificationOfNewTrack StackingAction::ClassifyNewTrack(const G4Track *track)
+{
+    auto vr = VarianceReduction::Instance();
+    if (!vr->IsKillingElectrons() || track->GetParentID() == 0 || track->GetDefinition() != G4Electron::Definition())
+        return fUrgent;
+
+    auto distance = vr->GetDistanceToTarget(track->GetPosition());
+    if (distance <= 0.)
+        return fUrgent;
+
+    // the longest range over all materials bounds the path in any of them
+    if (vr->GetMaxElectronRange(track->GetKineticEnergy()) >= distance)
+        return fUrgent;
+
+    return fKill;
+}
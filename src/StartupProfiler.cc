@@ -0,0 +1,37 @@
+#include "G4ios.hh"
+
+#include "StartupProfiler.hh"
+
+StartupProfiler *StartupProfiler::Instance()
+{
+    static StartupProfiler profiler;
+    return &profiler;
+}
+
+StartupProfiler::StartupProfiler()
+    : fStartTime(Clock::now()), fInitializedTime(fStartTime), fFirstEventSeen(false)
+{
+}
+
+void StartupProfiler::Start()
+{
+    fStartTime = Clock::now();
+    fInitializedTime = fStartTime;
+}
+
+void StartupProfiler::MarkInitialized()
+{
+    fInitializedTime = Clock::now();
+}
+
+void StartupProfiler::MarkFirstEvent()
+{
+    if (fFirstEventSeen.load(std::memory_order_relaxed) || fFirstEventSeen.exchange(true))
+        return;
+
+    auto now = Clock::now();
+    auto seconds = [](Clock::duration d) { return std::chrono::duration<G4double>(d).count(); };
+    G4cout << "Startup: first event after " << seconds(now - fStartTime) << " s"
+           << " (initialization " << seconds(fInitializedTime - fStartTime) << " s"
+           << ", run start " << seconds(now - fInitializedTime) << " s)" << G4endl;
+}
@@ -0,0 +1,45 @@
+#include "G4Step.hh"
+#include "G4Track.hh"
+#include "Randomize.hh"
+
+#include "SteppingAction.hh"
+#include "VarianceReduction.hh"
+#include "PointDetectorEstimator.hh"
+
+SteppingAction::SteppingAction()
+    : G4UserSteppingAction()
+{
+}
+
+SteppingAction::~SteppingAction()
+{
+}
+
+void SteppingAction::UserSteppingAction(const G4Step *step)
+{
+    // scored with the weight before any roulette of this step
+    PointDetectorEstimator::Instance()->ScoreCollision(step);
+
+    auto vr = VarianceReduction::Instance();
+    if (!vr->HasImportances())
+        return;
+
+    auto track = step->GetTrack();
+    if (track->GetTrackStatus() != fAlive)
+        return;
+
+    auto importanceRatio = vr->GetImportance(step->GetPostStepPoint()->GetPosition()) / vr->GetImportance(step->GetPreStepPoint()->GetPosition());
+    if (importanceRatio >= 1.)
+        return;
+
+    if (G4UniformRand() >= importanceRatio)
+    {
+        track->SetTrackStatus(fStopAndKill);
+        return;
+    }
+
+    // the post-step point becomes the next pre-step point, whose weight the scorers use
+    auto weight = track->GetWeight() / importanceRatio;
+    track->SetWeight(weight);
+    step->GetPostStepPoint()->SetWeight(weight);
+}
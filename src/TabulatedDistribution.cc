@@ -0,0 +1,214 @@
+#include "G4AutoLock.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4UIcommand.hh"
+#include "G4ios.hh"
+#include "Randomize.hh"
+
+#include "TabulatedDistribution.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#ifdef G4MULTITHREADED
+G4Mutex TabulatedDistribution::TabulatedDistributionMutex = G4MUTEX_INITIALIZER;
+#endif
+
+namespace
+{
+    std::map<G4String, std::shared_ptr<const TabulatedDistribution>> distributions;
+} // namespace
+
+std::shared_ptr<const TabulatedDistribution> TabulatedDistribution::OpenSpectrum(const G4String &fileName)
+{
+    return Open(fileName, true);
+}
+
+std::shared_ptr<const TabulatedDistribution> TabulatedDistribution::OpenAngularDistribution(const G4String &fileName)
+{
+    return Open(fileName, false);
+}
+
+std::shared_ptr<const TabulatedDistribution> TabulatedDistribution::Open(const G4String &fileName, G4bool isSpectrum)
+{
+#ifdef G4MULTITHREADED
+    G4AutoLock lock(&TabulatedDistributionMutex);
+#endif
+    auto key = (isSpectrum ? "spectrum:" : "angular:") + fileName;
+    auto iter = distributions.find(key);
+    if (iter != distributions.end())
+        return iter->second;
+
+    // failures are not cached, so that a file fixed or created later is read on the next attempt
+    std::shared_ptr<TabulatedDistribution> distribution(new TabulatedDistribution);
+    if (!distribution->Import(fileName, isSpectrum))
+        return nullptr;
+    if (!isSpectrum && (distribution->GetMinimum() < -1. || distribution->GetMaximum() > 1.))
+    {
+        G4cerr << "WARNING: The cosines in " << fileName << " are not within [-1, 1].\n";
+        return nullptr;
+    }
+
+    distribution->BuildAliasTable();
+    G4cout << (isSpectrum ? "Spectrum: " : "Angular distribution: ") << distribution->fLows.size()
+           << " intervals loaded from " << fileName << G4endl;
+    distributions[key] = distribution;
+
+    return distribution;
+}
+
+TabulatedDistribution::TabulatedDistribution()
+{
+}
+
+G4bool TabulatedDistribution::Import(const G4String &fileName, G4bool isSpectrum)
+{
+    std::ifstream ifs(fileName.c_str());
+    if (!ifs.is_open())
+    {
+        G4cerr << "WARNING: Cannot open " << fileName << ".\n";
+        return false;
+    }
+
+    G4String format;
+    G4double unit = isSpectrum ? MeV : 1.;
+    std::vector<G4double> xs, ys;
+    std::string line;
+    while (std::getline(ifs, line))
+    {
+        std::istringstream iss(line.substr(0, line.find('#')));
+        std::string keyword;
+        if (!(iss >> keyword))
+            continue;
+
+        if (format.empty())
+        {
+            format = keyword;
+            if (format != "histogram" && format != "points")
+            {
+                G4cerr << "WARNING: " << fileName << " must start with 'histogram' or 'points'.\n";
+                return false;
+            }
+            continue;
+        }
+        if (keyword == "unit" && isSpectrum)
+        {
+            std::string unitName;
+            iss >> unitName;
+            unit = G4UIcommand::ValueOf(unitName.c_str());
+            continue;
+        }
+
+        std::istringstream values(line.substr(0, line.find('#')));
+        G4double x, y, content;
+        if (format == "histogram" && (values >> x >> y >> content) && y > x && content >= 0.)
+        {
+            fLows.push_back(x * unit);
+            fHighs.push_back(y * unit);
+            fLowDensities.push_back(content / (y - x));
+            fHighDensities.push_back(content / (y - x));
+        }
+        else if (format == "points" && (values >> x >> y) && y >= 0.)
+        {
+            xs.push_back(x * unit);
+            ys.push_back(y);
+        }
+        else
+        {
+            G4cerr << "WARNING: Invalid line in " << fileName << ": " << line << "\n";
+            return false;
+        }
+    }
+
+    for (std::size_t i = 1; i < xs.size(); ++i)
+    {
+        fLows.push_back(xs[i - 1]);
+        fHighs.push_back(xs[i]);
+        fLowDensities.push_back(ys[i - 1]);
+        fHighDensities.push_back(ys[i]);
+    }
+
+    // intervals must be ordered for GetDensity(); normalize to a unit area
+    G4double area = 0.;
+    for (std::size_t i = 0; i < fLows.size(); ++i)
+    {
+        if (fHighs[i] <= fLows[i] || (i > 0 && fLows[i] < fHighs[i - 1]))
+        {
+            G4cerr << "WARNING: The values in " << fileName << " are not increasing.\n";
+            return false;
+        }
+        area += .5 * (fLowDensities[i] + fHighDensities[i]) * (fHighs[i] - fLows[i]);
+    }
+    if (area <= 0.)
+    {
+        G4cerr << "WARNING: " << fileName << " has no probability.\n";
+        return false;
+    }
+    for (std::size_t i = 0; i < fLows.size(); ++i)
+    {
+        fLowDensities[i] /= area;
+        fHighDensities[i] /= area;
+    }
+
+    return true;
+}
+
+void TabulatedDistribution::BuildAliasTable()
+{
+    // Vose's alias method over the interval probabilities
+    auto n = fLows.size();
+    std::vector<G4double> scaled(n);
+    std::vector<std::size_t> small, large;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        scaled[i] = .5 * (fLowDensities[i] + fHighDensities[i]) * (fHighs[i] - fLows[i]) * n;
+        (scaled[i] < 1. ? small : large).push_back(i);
+    }
+
+    fAliasProbabilities.assign(n, 1.);
+    fAliases.resize(n);
+    for (std::size_t i = 0; i < n; ++i)
+        fAliases[i] = static_cast<G4int>(i);
+    while (!small.empty() && !large.empty())
+    {
+        auto less = small.back();
+        small.pop_back();
+        auto more = large.back();
+        large.pop_back();
+
+        fAliasProbabilities[less] = scaled[less];
+        fAliases[less] = static_cast<G4int>(more);
+        scaled[more] -= 1. - scaled[less];
+        (scaled[more] < 1. ? small : large).push_back(more);
+    }
+}
+
+G4double TabulatedDistribution::Sample() const
+{
+    auto u = G4UniformRand() * fAliasProbabilities.size();
+    auto i = std::min(static_cast<std::size_t>(u), fAliasProbabilities.size() - 1);
+    if (u - i >= fAliasProbabilities[i])
+        i = fAliases[i];
+
+    // inverse CDF of the linear density inside the interval
+    auto y0 = fLowDensities[i], y1 = fHighDensities[i];
+    auto r = G4UniformRand();
+    auto t = (std::abs(y1 - y0) <= 1e-9 * (y0 + y1)) ? r : (std::sqrt(y0 * y0 + (y1 * y1 - y0 * y0) * r) - y0) / (y1 - y0);
+
+    return fLows[i] + t * (fHighs[i] - fLows[i]);
+}
+
+G4double TabulatedDistribution::GetDensity(G4double x) const
+{
+    auto iter = std::upper_bound(fLows.begin(), fLows.end(), x);
+    if (iter == fLows.begin())
+        return 0.;
+    auto i = iter - fLows.begin() - 1;
+    if (x > fHighs[i])
+        return 0.;
+
+    auto t = (x - fLows[i]) / (fHighs[i] - fLows[i]);
+    return fLowDensities[i] + t * (fHighDensities[i] - fLowDensities[i]);
+}
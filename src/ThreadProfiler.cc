@@ -0,0 +1,126 @@
+#include "G4GenericMessenger.hh"
+#include "G4ios.hh"
+
+#include "ThreadProfiler.hh"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+ThreadProfiler *ThreadProfiler::fInstance = nullptr;
+G4ThreadLocal G4double ThreadProfiler::fStageTimes[ThreadProfiler::kNumberOfStages] = {0., 0., 0.};
+G4ThreadLocal G4int ThreadProfiler::fNumberOfEvents = 0;
+G4ThreadLocal ThreadProfiler::Clock::rep ThreadProfiler::fLastMark = 0;
+#ifdef G4MULTITHREADED
+G4Mutex ThreadProfiler::ThreadProfilerMutex = G4MUTEX_INITIALIZER;
+#endif
+
+ThreadProfiler *ThreadProfiler::Instance()
+{
+    if (fInstance == nullptr)
+    {
+#ifdef G4MULTITHREADED
+        G4MUTEXLOCK(&ThreadProfilerMutex);
+        if (fInstance == nullptr)
+        {
+#endif
+            fInstance = new ThreadProfiler;
+#ifdef G4MULTITHREADED
+        }
+        G4MUTEXUNLOCK(&ThreadProfilerMutex);
+#endif
+    }
+
+    return fInstance;
+}
+
+ThreadProfiler::ThreadProfiler()
+    : fEnabled(false)
+{
+    fMessenger = new G4GenericMessenger(this, "/advpg/profile/", "Event loop profiling");
+    auto &enableCmd = fMessenger->DeclareProperty("enable", fEnabled,
+                                                  "Time generation, transport and output of every event loop thread.");
+    enableCmd.SetStates(G4State_PreInit, G4State_Idle);
+    enableCmd.command->SetToBeBroadcasted(false);
+}
+
+ThreadProfiler::~ThreadProfiler()
+{
+    delete fMessenger;
+    fInstance = nullptr;
+}
+
+void ThreadProfiler::BeginOfRun()
+{
+    for (auto &stageTime : fStageTimes)
+        stageTime = 0.;
+    fNumberOfEvents = 0;
+}
+
+void ThreadProfiler::Mark(Stage finishedStage)
+{
+    auto now = Clock::now().time_since_epoch().count();
+    fStageTimes[finishedStage] += std::chrono::duration<G4double>(Clock::duration(now - fLastMark)).count();
+    fLastMark = now;
+}
+
+void ThreadProfiler::StartEvent()
+{
+    if (fEnabled)
+        fLastMark = Clock::now().time_since_epoch().count();
+}
+
+void ThreadProfiler::StartTransport()
+{
+    if (fEnabled)
+        Mark(kGeneration);
+}
+
+void ThreadProfiler::StartOutput()
+{
+    if (fEnabled)
+        Mark(kTransport);
+}
+
+void ThreadProfiler::EndEvent()
+{
+    if (!fEnabled)
+        return;
+    Mark(kOutput);
+    ++fNumberOfEvents;
+}
+
+void ThreadProfiler::PrintThread() const
+{
+    if (!fEnabled)
+        return;
+
+    G4cout << "PROFILE thread id=" << G4Threading::G4GetThreadId() << " events=" << fNumberOfEvents
+           << " generation=" << fStageTimes[kGeneration] << " transport=" << fStageTimes[kTransport]
+           << " output=" << fStageTimes[kOutput] << G4endl;
+}
+
+void ThreadProfiler::PrintRun(G4int numberOfThreads, G4int numberOfEvents, G4double time) const
+{
+    if (!fEnabled)
+        return;
+
+    G4cout << "PROFILE run threads=" << numberOfThreads << " events=" << numberOfEvents << " time=" << time
+           << " rss=" << GetResidentMemory() << G4endl;
+}
+
+G4double ThreadProfiler::GetResidentMemory()
+{
+    std::ifstream ifs("/proc/self/status");
+    std::string line;
+    while (std::getline(ifs, line))
+    {
+        if (line.compare(0, 6, "VmRSS:") != 0)
+            continue;
+        std::istringstream iss(line.substr(6));
+        G4double kB = 0.;
+        iss >> kB;
+        return kB / 1024.;
+    }
+    return 0.;
+}
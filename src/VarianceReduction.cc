@@ -0,0 +1,174 @@
+#include "G4Electron.hh"
+#include "G4EmCalculator.hh"
+#include "G4GenericMessenger.hh"
+#include "G4LogicalVolume.hh"
+#include "G4Material.hh"
+#include "G4PhysicalVolumeStore.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4UIcommand.hh"
+#include "G4VSolid.hh"
+#include "G4ios.hh"
+
+#include "VarianceReduction.hh"
+#include "AdvancedParticleGun.hh"
+#include "EnergyGrid.hh"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <sstream>
+
+VarianceReduction *VarianceReduction::fInstance = nullptr;
+#ifdef G4MULTITHREADED
+G4Mutex VarianceReduction::VarianceReductionMutex = G4MUTEX_INITIALIZER;
+#endif
+
+VarianceReduction *VarianceReduction::Instance()
+{
+    if (fInstance == nullptr)
+    {
+#ifdef G4MULTITHREADED
+        G4MUTEXLOCK(&VarianceReductionMutex);
+        if (fInstance == nullptr)
+        {
+#endif
+            fInstance = new VarianceReduction;
+#ifdef G4MULTITHREADED
+        }
+        G4MUTEXUNLOCK(&VarianceReductionMutex);
+#endif
+    }
+
+    return fInstance;
+}
+
+VarianceReduction::VarianceReduction()
+    : fTargetName("Detector"), fKillElectrons(false), fAnalogFOM(0.), fTargetRadius(0.)
+{
+    fMessenger = new G4GenericMessenger(this, "/advpg/vr/", "Track killing and Russian roulette");
+
+    auto &targetCmd = fMessenger->DeclareProperty("target", fTargetName,
+                                                  "Physical volume that tracks must be able to reach.");
+    targetCmd.SetStates(G4State_PreInit, G4State_Idle);
+    targetCmd.command->SetToBeBroadcasted(false);
+
+    auto &killCmd = fMessenger->DeclareProperty("killElectrons", fKillElectrons,
+                                                "Kill secondary electrons whose range in any material is shorter than "
+                                                "their distance to the target (their bremsstrahlung is neglected).");
+    killCmd.SetStates(G4State_PreInit, G4State_Idle);
+    killCmd.command->SetToBeBroadcasted(false);
+
+    auto &importanceCmd = fMessenger->DeclareMethod("addImportance", &VarianceReduction::AddImportance,
+                                                    "Add an importance sphere around the target: <radius> <unit> <importance>. "
+                                                    "Tracks moving to a lower importance undergo Russian roulette.");
+    importanceCmd.SetStates(G4State_PreInit, G4State_Idle);
+    importanceCmd.command->SetToBeBroadcasted(false);
+
+    auto &clearCmd = fMessenger->DeclareMethod("clearImportances", &VarianceReduction::ClearImportances,
+                                               "Remove all importance spheres.");
+    clearCmd.SetStates(G4State_PreInit, G4State_Idle);
+    clearCmd.command->SetToBeBroadcasted(false);
+
+    auto &fomCmd = fMessenger->DeclareProperty("analogFOM", fAnalogFOM,
+                                               "Figure of merit (1/s) of an analog run, used to report the gain. "
+                                               "Set automatically by every run without variance reduction.");
+    fomCmd.SetStates(G4State_PreInit, G4State_Idle);
+    fomCmd.command->SetToBeBroadcasted(false);
+}
+
+VarianceReduction::~VarianceReduction()
+{
+    delete fMessenger;
+    fInstance = nullptr;
+}
+
+void VarianceReduction::AddImportance(G4String parameters)
+{
+    std::istringstream iss(parameters);
+    G4double radius, importance;
+    G4String unit;
+    if (!(iss >> radius >> unit >> importance) || radius <= 0. || importance <= 0.)
+    {
+        G4cerr << "WARNING: addImportance expects <radius> <unit> <importance>, all positive.\n";
+        return;
+    }
+
+    fImportances.push_back({radius * G4UIcommand::ValueOf(unit), importance});
+    std::sort(fImportances.begin(), fImportances.end(),
+              [](const ImportanceSphere &a, const ImportanceSphere &b) { return a.fRadius < b.fRadius; });
+}
+
+void VarianceReduction::ClearImportances()
+{
+    fImportances.clear();
+}
+
+void VarianceReduction::Prepare()
+{
+    if (!IsEnabled())
+        return;
+
+    auto targetVol = G4PhysicalVolumeStore::GetInstance()->GetVolume(fTargetName);
+    if (!targetVol)
+    {
+        G4cerr << "WARNING: There is no " << fTargetName << "; variance reduction is disabled.\n";
+        fKillElectrons = false;
+        fImportances.clear();
+        return;
+    }
+
+    // a rouletted history loses the deposits of its killed tracks, and no weight
+    // of the surviving tracks restores the distribution of the summed deposit
+    if (!IsScoringPulseHeights())
+        G4cerr << "WARNING: With importance spheres, EDep, EDepRes, the EDep ntuple and the response matrix "
+                  "are not filled; only the weighted total deposit and the point receptors are scored.\n";
+
+    G4ThreeVector boundMin, boundMax;
+    targetVol->GetLogicalVolume()->GetSolid()->BoundingLimits(boundMin, boundMax);
+    fTargetRadius = .5 * (boundMax - boundMin).mag();
+
+    // bounding-box center, moved up to the world frame
+    fTargetCenter = AdvancedParticleGun::ConvertCoordVolume2World(targetVol, .5 * (boundMin + boundMax));
+
+    // materials and production cuts may change between runs
+    if (fKillElectrons)
+        BuildElectronRangeTable();
+}
+
+void VarianceReduction::BuildElectronRangeTable()
+{
+    G4EmCalculator emCalculator;
+    auto electron = G4Electron::Definition();
+    fMaxElectronRanges.assign(EnergyGrid::kNumberOfEnergies, 0.);
+    for (G4int i = 0; i < EnergyGrid::kNumberOfEnergies; ++i)
+    {
+        auto energy = EnergyGrid::GetEnergy(i);
+        for (const auto material : *G4Material::GetMaterialTable())
+        {
+            // a material without a range table never lets electrons be killed
+            auto range = emCalculator.GetRangeFromRestricteDEDX(energy, electron, material);
+            fMaxElectronRanges[i] = std::max(fMaxElectronRanges[i], (range > 0.) ? range : DBL_MAX);
+        }
+    }
+}
+
+G4double VarianceReduction::GetMaxElectronRange(G4double energy) const
+{
+    // the range grows with the energy, so the next table energy bounds it from above
+    auto x = EnergyGrid::GetIndex(energy);
+    auto i = static_cast<G4int>(std::ceil(x));
+    if (i >= EnergyGrid::kNumberOfEnergies || fMaxElectronRanges.empty())
+        return DBL_MAX;
+    return fMaxElectronRanges[i];
+}
+
+G4double VarianceReduction::GetImportance(const G4ThreeVector &position) const
+{
+    auto distance = (position - fTargetCenter).mag();
+    for (const auto &sphere : fImportances)
+    {
+        if (distance <= sphere.fRadius)
+            return sphere.fImportance;
+    }
+    return 1.;
+}
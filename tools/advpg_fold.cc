@@ -0,0 +1,348 @@
+/// \file advpg_fold.cc
+/// \brief Folds a response matrix of example_advpg with ICRP 107 photon lines.
+///
+/// Usage: advpg_fold <output.csv> <response.dat>[,<response2.dat>...] <nuclide>[:<activity Bq>] [...] [-fwhm <a> <b> <c>]
+///
+/// The pulse-height spectrum is the yield-weighted sum of the matrix rows over
+/// the lines of the nuclides and their daughters. A line between two grid
+/// energies interpolates linearly between their rows, each with its deposited
+/// energy axis scaled to the line energy, so that the full-energy peak stays
+/// at the line. The response files of several shards are summed. The errors
+/// are propagated once per matrix cell after all lines are accumulated, so
+/// that lines folded with the same rows are not treated as independent.
+
+#include "G4String.hh"
+#include "G4SystemOfUnits.hh"
+
+#include "ICRP07Manager.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    void PrintUsage()
+    {
+        std::cerr << " Usage: " << std::endl
+                  << " advpg_fold <output.csv> <response.dat>[,<response2.dat>...] <nuclide>[:<activity Bq>] [...] [-fwhm <a> <b> <c>]" << std::endl
+                  << "\tActivities default to 1 Bq, i.e. the spectrum is per decay of each nuclide." << std::endl
+                  << "\t-fwhm applies the Gaussian resolution FWHM(E) = sqrt(a^2 + b^2 E + c^2 E^2), E in MeV." << std::endl;
+    }
+
+    struct Response
+    {
+        G4int fNumberOfDepositBins = 0;
+        G4double fMaxDeposit = 0.; // MeV
+        std::vector<G4double> fIncidentEnergies; // MeV
+        std::vector<std::uint64_t> fNumberOfHistories;
+        std::vector<G4double> fSumWeights, fSumWeights2;
+    };
+
+    bool ReadResponse(const std::string &fileName, Response &response)
+    {
+        std::ifstream ifs(fileName.c_str());
+        if (!ifs.is_open())
+        {
+            std::cerr << "Cannot open " << fileName << std::endl;
+            return false;
+        }
+
+        auto first = response.fIncidentEnergies.empty();
+        std::string line;
+        while (std::getline(ifs, line))
+        {
+            std::istringstream iss(line.substr(0, line.find('#')));
+            std::string keyword;
+            if (!(iss >> keyword))
+                continue;
+
+            if (keyword == "deposit")
+            {
+                G4int nBins;
+                G4double maxDeposit;
+                iss >> nBins >> maxDeposit;
+                if (!first && (nBins != response.fNumberOfDepositBins || maxDeposit != response.fMaxDeposit))
+                {
+                    std::cerr << fileName << " has another deposit binning." << std::endl;
+                    return false;
+                }
+                response.fNumberOfDepositBins = nBins;
+                response.fMaxDeposit = maxDeposit;
+            }
+            else if (keyword == "incident")
+            {
+                std::size_t index;
+                G4double energy;
+                std::uint64_t nHistories;
+                iss >> index >> energy >> nHistories;
+                if (first && index == response.fIncidentEnergies.size())
+                {
+                    response.fIncidentEnergies.push_back(energy);
+                    response.fNumberOfHistories.push_back(nHistories);
+                }
+                else if (!first && index < response.fIncidentEnergies.size() && energy == response.fIncidentEnergies[index])
+                    response.fNumberOfHistories[index] += nHistories;
+                else
+                {
+                    std::cerr << fileName << " has another incident energy grid." << std::endl;
+                    return false;
+                }
+            }
+            else if (keyword == "cell")
+            {
+                if (response.fSumWeights.empty())
+                {
+                    response.fSumWeights.assign(response.fIncidentEnergies.size() * response.fNumberOfDepositBins, 0.);
+                    response.fSumWeights2.assign(response.fIncidentEnergies.size() * response.fNumberOfDepositBins, 0.);
+                }
+                std::size_t index, bin;
+                G4double sumWeights, sumWeights2;
+                if (!(iss >> index >> bin >> sumWeights >> sumWeights2) || index >= response.fIncidentEnergies.size() ||
+                    bin >= static_cast<std::size_t>(response.fNumberOfDepositBins))
+                {
+                    std::cerr << "Invalid line in " << fileName << ": " << line << std::endl;
+                    return false;
+                }
+                response.fSumWeights[index * response.fNumberOfDepositBins + bin] += sumWeights;
+                response.fSumWeights2[index * response.fNumberOfDepositBins + bin] += sumWeights2;
+            }
+        }
+
+        if (response.fNumberOfDepositBins < 1 || response.fIncidentEnergies.size() < 2)
+        {
+            std::cerr << fileName << " is not a response matrix with two or more incident energies." << std::endl;
+            return false;
+        }
+        if (response.fSumWeights.empty())
+        {
+            response.fSumWeights.assign(response.fIncidentEnergies.size() * response.fNumberOfDepositBins, 0.);
+            response.fSumWeights2.assign(response.fIncidentEnergies.size() * response.fNumberOfDepositBins, 0.);
+        }
+        return true;
+    }
+
+    // Linear map from the matrix cells to the folded spectrum: for every cell
+    // (row k, deposit bin b) the coefficients of the spectrum bins it feeds. All
+    // lines are accumulated before the errors are propagated, because lines on
+    // the same rows share the statistical fluctuations of those rows.
+    typedef std::vector<std::pair<G4int, G4double>> Coefficients;
+    typedef std::vector<Coefficients> Transfer; // cell k * nBins + b
+
+    void AddCoefficient(Coefficients &coefficients, G4int j, G4double value)
+    {
+        for (auto &coefficient : coefficients)
+        {
+            if (coefficient.first == j)
+            {
+                coefficient.second += value;
+                return;
+            }
+        }
+        coefficients.emplace_back(j, value);
+    }
+
+    // Adds coefficient times row k, with its deposit axis scaled by the given factor, to the transfer.
+    void AddScaledRow(const Response &response, std::size_t k, G4double coefficient, G4double scale, Transfer &transfer)
+    {
+        auto nBins = response.fNumberOfDepositBins;
+        auto width = response.fMaxDeposit / nBins;
+        for (G4int b = 0; b < nBins; ++b)
+        {
+            if (response.fSumWeights[k * nBins + b] <= 0.)
+                continue;
+
+            auto low = b * width * scale, high = (b + 1) * width * scale;
+            for (auto j = static_cast<G4int>(low / width); j < nBins && j * width < high; ++j)
+            {
+                auto fraction = (std::min(high, (j + 1) * width) - std::max(low, j * width)) / (high - low);
+                if (fraction > 0.)
+                    AddCoefficient(transfer[k * nBins + b], j, coefficient * fraction);
+            }
+        }
+    }
+
+    // Spreads every coefficient over the spectrum bins by the Gaussian resolution.
+    void Broaden(const Response &response, G4double a, G4double b, G4double c, Transfer &transfer)
+    {
+        auto nBins = response.fNumberOfDepositBins;
+        auto width = response.fMaxDeposit / nBins;
+
+        // fractions of spectrum bin i falling into the other bins
+        std::vector<Coefficients> kernels(nBins);
+        for (G4int i = 0; i < nBins; ++i)
+        {
+            auto e = (i + .5) * width;
+            auto sigma = std::sqrt(a * a + b * b * e + c * c * e * e) / 2.354820045;
+            if (sigma <= 0.)
+            {
+                kernels[i].emplace_back(i, 1.);
+                continue;
+            }
+            auto low = std::max(static_cast<G4int>((e - 6. * sigma) / width), 0);
+            auto high = std::min(static_cast<G4int>((e + 6. * sigma) / width), nBins - 1);
+            for (auto j = low; j <= high; ++j)
+                kernels[i].emplace_back(j, .5 * (std::erf(((j + 1) * width - e) / (std::sqrt(2.) * sigma)) - std::erf((j * width - e) / (std::sqrt(2.) * sigma))));
+        }
+
+        for (auto &coefficients : transfer)
+        {
+            if (coefficients.empty())
+                continue;
+
+            Coefficients broadened;
+            for (const auto &coefficient : coefficients)
+            {
+                for (const auto &fraction : kernels[coefficient.first])
+                    AddCoefficient(broadened, fraction.first, coefficient.second * fraction.second);
+            }
+            coefficients.swap(broadened);
+        }
+    }
+
+    // Spectrum and variance of the transfer applied to the matrix, the cells being independent.
+    void Fold(const Response &response, const Transfer &transfer, std::vector<G4double> &spectrum, std::vector<G4double> &variance)
+    {
+        auto nBins = response.fNumberOfDepositBins;
+        for (std::size_t cell = 0; cell < transfer.size(); ++cell)
+        {
+            if (transfer[cell].empty())
+                continue;
+
+            // mean and its variance over the histories of the row
+            auto n = static_cast<G4double>(response.fNumberOfHistories[cell / nBins]);
+            auto mean = response.fSumWeights[cell] / n;
+            auto meanVariance = (n > 1.) ? std::max(response.fSumWeights2[cell] / n - mean * mean, 0.) / (n - 1.) : mean * mean;
+
+            for (const auto &coefficient : transfer[cell])
+            {
+                spectrum[coefficient.first] += coefficient.second * mean;
+                variance[coefficient.first] += coefficient.second * coefficient.second * meanVariance;
+            }
+        }
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    Response response;
+    std::istringstream responseFiles(argv[2]);
+    std::string responseFile;
+    while (std::getline(responseFiles, responseFile, ','))
+    {
+        if (!ReadResponse(responseFile, response))
+            return 1;
+    }
+
+    std::vector<std::pair<std::string, G4double>> nuclides;
+    G4double a = 0., b = 0., c = 0.;
+    for (G4int i = 3; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "-fwhm" && i + 3 < argc)
+        {
+            a = std::atof(argv[++i]);
+            b = std::atof(argv[++i]);
+            c = std::atof(argv[++i]);
+        }
+        else if (arg[0] != '-')
+        {
+            auto colon = arg.find(':');
+            nuclides.emplace_back(arg.substr(0, colon), colon == std::string::npos ? 1. : std::atof(arg.substr(colon + 1).c_str()));
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    // the lines of all nuclides, yields times activities, energies in MeV
+    auto icrp107 = ICRP07Manager::Instance();
+    std::vector<std::pair<G4double, G4double>> lines;
+    for (const auto &nuclide : nuclides)
+    {
+        auto photonSource = icrp107->GetPhotonSourceAllDaughters(nuclide.first);
+        if (photonSource.fPhotonEnergies.empty())
+        {
+            std::cerr << "No photon lines for " << nuclide.first << std::endl;
+            return 1;
+        }
+        for (std::size_t i = 0; i < photonSource.fPhotonEnergies.size(); ++i)
+            lines.emplace_back(photonSource.fPhotonEnergies[i] / MeV, photonSource.fYields[i] * nuclide.second);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    const auto &energies = response.fIncidentEnergies;
+    Transfer transfer(energies.size() * response.fNumberOfDepositBins);
+    G4double totalYield = 0., skippedYield = 0.;
+    for (const auto &line : lines)
+    {
+        totalYield += line.second;
+        if (line.first < energies.front() || line.first > energies.back())
+        {
+            skippedYield += line.second;
+            continue;
+        }
+
+        // rows k and k + 1 enclose the line
+        auto k = std::min(static_cast<std::size_t>(std::upper_bound(energies.begin(), energies.end(), line.first) - energies.begin()) - 1,
+                          energies.size() - 2);
+        auto t = (line.first - energies[k]) / (energies[k + 1] - energies[k]);
+        if ((t < 1. && response.fNumberOfHistories[k] == 0) || (t > 0. && response.fNumberOfHistories[k + 1] == 0))
+        {
+            skippedYield += line.second;
+            continue;
+        }
+        if (t < 1.)
+            AddScaledRow(response, k, line.second * (1. - t), line.first / energies[k], transfer);
+        if (t > 0.)
+            AddScaledRow(response, k + 1, line.second * t, line.first / energies[k + 1], transfer);
+    }
+    if (a > 0. || b > 0. || c > 0.)
+        Broaden(response, a, b, c, transfer);
+
+    std::vector<G4double> spectrum(response.fNumberOfDepositBins, 0.), variance(response.fNumberOfDepositBins, 0.);
+    Fold(response, transfer, spectrum, variance);
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::ofstream ofs(argv[1]);
+    if (!ofs.is_open())
+    {
+        std::cerr << "Cannot write " << argv[1] << std::endl;
+        return 1;
+    }
+    ofs << "# advpg_fold";
+    for (G4int i = 2; i < argc; ++i)
+        ofs << " " << argv[i];
+    ofs << "\n# counts per second for the given activities (per decay with the default 1 Bq); errors include the correlation of lines sharing matrix rows\n"
+        << "Edep_low(MeV),Edep_high(MeV),Counts,Error\n";
+    ofs.precision(std::numeric_limits<G4double>::max_digits10);
+    auto width = response.fMaxDeposit / response.fNumberOfDepositBins;
+    for (G4int j = 0; j < response.fNumberOfDepositBins; ++j)
+        ofs << j * width << "," << (j + 1) * width << "," << spectrum[j] << "," << std::sqrt(variance[j]) << "\n";
+
+    std::cout << "Folded " << lines.size() << " lines of " << nuclides.size() << " nuclides over " << energies.size()
+              << " incident energies in " << elapsed << " ms" << std::endl;
+    if (skippedYield > 0.)
+        std::cout << "WARNING: " << 100. * skippedYield / totalYield << " % of the yield is outside the grid ["
+                  << energies.front() << ", " << energies.back() << "] MeV or on rows without histories." << std::endl;
+
+    return 0;
+}
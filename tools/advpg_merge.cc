@@ -0,0 +1,412 @@
+/// \file advpg_merge.cc
+/// \brief Merges the CSV outputs of sharded example_advpg jobs.
+///
+/// Usage: advpg_merge <output.csv> <input1.csv> [input2.csv ...]
+///
+/// Histograms (tools::histo) are summed bin by bin, and inputs with another
+/// binning are rejected. Ntuples are concatenated. The point receptor sums
+/// (NEE*.csv) are added receptor by receptor. All inputs are streamed row by row, so the memory use does
+/// not depend on their size.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    void PrintUsage()
+    {
+        std::cerr << " Usage: " << std::endl
+                  << " advpg_merge <output.csv> <input1.csv> [input2.csv ...]" << std::endl
+                  << "\tInputs must be the same histogram, ntuple or point receptor file written by different shards." << std::endl;
+    }
+
+    std::vector<std::string> Split(const std::string &line, char separator)
+    {
+        std::vector<std::string> tokens;
+        std::stringstream ss(line);
+        std::string token;
+        while (std::getline(ss, token, separator))
+            tokens.push_back(token);
+        return tokens;
+    }
+
+    std::vector<double> ParseRow(const std::string &line, char separator)
+    {
+        std::vector<double> values;
+        for (const auto &token : Split(line, separator))
+            values.push_back(std::strtod(token.c_str(), nullptr));
+        return values;
+    }
+
+    // Reads the '#' header lines and the line following them (column names
+    // for histograms, first data row for ntuples).
+    bool ReadHeader(std::ifstream &ifs, std::vector<std::string> &header, std::string &nextLine)
+    {
+        header.clear();
+        while (std::getline(ifs, nextLine))
+        {
+            if (nextLine.empty() || nextLine[0] != '#')
+                return true;
+            header.push_back(nextLine);
+        }
+        nextLine.clear();
+        return !header.empty();
+    }
+
+    std::string GetHeaderValue(const std::vector<std::string> &header, const std::string &key)
+    {
+        for (const auto &line : header)
+        {
+            if (line.compare(0, key.size() + 1, key + " ") == 0)
+                return line.substr(key.size() + 1);
+        }
+        return "";
+    }
+
+    // Header lines fixing the binning: dimension, axes and number of bins.
+    std::vector<std::string> GetBinning(const std::vector<std::string> &header)
+    {
+        std::vector<std::string> binning;
+        for (const auto &line : header)
+        {
+            if (line.compare(0, 10, "#dimension") == 0 || line.compare(0, 5, "#axis") == 0 || line.compare(0, 11, "#bin_number") == 0)
+                binning.push_back(line);
+        }
+        return binning;
+    }
+
+    int MergeHistograms(std::ofstream &ofs, const std::vector<std::string> &inputs)
+    {
+        std::vector<std::unique_ptr<std::ifstream>> files;
+        std::vector<std::string> header, columns;
+        for (const auto &input : inputs)
+        {
+            files.emplace_back(new std::ifstream(input.c_str()));
+            std::vector<std::string> fileHeader;
+            std::string fileColumns;
+            if (!ReadHeader(*files.back(), fileHeader, fileColumns))
+            {
+                std::cerr << "ERROR: Cannot read " << input << "." << std::endl;
+                return 1;
+            }
+            if (files.size() == 1)
+            {
+                header = fileHeader;
+                columns.push_back(fileColumns);
+            }
+            else if (GetBinning(fileHeader) != GetBinning(header) || fileColumns != columns[0])
+            {
+                std::cerr << "ERROR: " << input << " does not have the binning of " << inputs[0] << "." << std::endl;
+                return 1;
+            }
+        }
+
+        for (const auto &line : header)
+            ofs << line << "\n";
+        ofs << columns[0] << "\n";
+
+        // columns: entries, Sw, Sw2, Sxw0, Sx2w0; the first and last rows are under/overflow
+        const auto names = Split(columns[0], ',');
+        std::vector<double> inRange(names.size(), 0.);
+        std::vector<double> lastRow;
+        std::size_t nRows = 0;
+        std::string line;
+        while (std::getline(*files[0], line))
+        {
+            auto sum = ParseRow(line, ',');
+            for (std::size_t i = 1; i < files.size(); ++i)
+            {
+                if (!std::getline(*files[i], line))
+                {
+                    std::cerr << "ERROR: " << inputs[i] << " has fewer bins than " << inputs[0] << "." << std::endl;
+                    return 1;
+                }
+                auto row = ParseRow(line, ',');
+                if (row.size() != sum.size())
+                {
+                    std::cerr << "ERROR: " << inputs[i] << " has a row with another number of columns than " << inputs[0] << "." << std::endl;
+                    return 1;
+                }
+                for (std::size_t j = 0; j < sum.size(); ++j)
+                    sum[j] += row[j];
+            }
+
+            for (std::size_t j = 0; j < sum.size(); ++j)
+                ofs << (j > 0 ? "," : "") << sum[j];
+            ofs << "\n";
+
+            // a row is in range once it is neither the first (underflow) nor the last (overflow)
+            if (nRows >= 2)
+            {
+                for (std::size_t j = 0; j < lastRow.size() && j < inRange.size(); ++j)
+                    inRange[j] += lastRow[j];
+            }
+            lastRow = sum;
+            ++nRows;
+        }
+        for (std::size_t i = 1; i < files.size(); ++i)
+        {
+            if (std::getline(*files[i], line) && !line.empty())
+            {
+                std::cerr << "ERROR: " << inputs[i] << " has more bins than " << inputs[0] << "." << std::endl;
+                return 1;
+            }
+        }
+
+        std::cout << "Histogram " << GetHeaderValue(header, "#title") << ": " << nRows << " bins from "
+                  << inputs.size() << " files" << std::endl;
+        if (inRange.size() >= 5 && inRange[1] > 0.)
+        {
+            auto mean = inRange[3] / inRange[1];
+            auto rms = std::sqrt(std::max(inRange[4] / inRange[1] - mean * mean, 0.));
+            std::cout << " -- entries " << inRange[0]
+                      << ", sum of weights " << inRange[1] << " +- " << std::sqrt(inRange[2])
+                      << " (relative error " << std::sqrt(inRange[2]) / inRange[1] << ")"
+                      << ", mean " << mean << ", rms " << rms << std::endl;
+        }
+        return 0;
+    }
+
+    int MergeNtuples(std::ofstream &ofs, const std::vector<std::string> &inputs)
+    {
+        std::vector<std::string> header, columnNames;
+        char separator = ',';
+        std::size_t weightColumn = std::string::npos;
+        std::vector<double> sumWX;
+        double sumW = 0., sumW2 = 0.;
+        std::size_t nRows = 0;
+
+        for (const auto &input : inputs)
+        {
+            std::ifstream ifs(input.c_str());
+            std::vector<std::string> fileHeader;
+            std::string line;
+            if (!ReadHeader(ifs, fileHeader, line))
+            {
+                std::cerr << "ERROR: Cannot read " << input << "." << std::endl;
+                return 1;
+            }
+
+            std::vector<std::string> fileColumns;
+            for (const auto &headerLine : fileHeader)
+            {
+                if (headerLine.compare(0, 8, "#column ") == 0)
+                    fileColumns.push_back(headerLine.substr(headerLine.find(' ', 8) + 1));
+            }
+
+            if (header.empty())
+            {
+                header = fileHeader;
+                columnNames = fileColumns;
+                auto separatorCode = GetHeaderValue(header, "#separator");
+                if (!separatorCode.empty())
+                    separator = static_cast<char>(std::stoi(separatorCode));
+                for (std::size_t i = 0; i < columnNames.size(); ++i)
+                {
+                    if (columnNames[i] == "Weight")
+                        weightColumn = i;
+                }
+                sumWX.assign(columnNames.size(), 0.);
+                for (const auto &headerLine : header)
+                    ofs << headerLine << "\n";
+            }
+            else if (fileColumns != columnNames)
+            {
+                std::cerr << "ERROR: " << input << " does not have the columns of " << inputs[0] << "." << std::endl;
+                return 1;
+            }
+
+            do
+            {
+                if (line.empty())
+                    continue;
+                ofs << line << "\n";
+                ++nRows;
+
+                if (weightColumn == std::string::npos)
+                    continue;
+                auto row = ParseRow(line, separator);
+                if (row.size() <= weightColumn)
+                    continue;
+                auto weight = row[weightColumn];
+                sumW += weight;
+                sumW2 += weight * weight;
+                for (std::size_t i = 0; i < row.size() && i < sumWX.size(); ++i)
+                    sumWX[i] += weight * row[i];
+            } while (std::getline(ifs, line));
+        }
+
+        std::cout << "Ntuple " << GetHeaderValue(header, "#title") << ": " << nRows << " rows from "
+                  << inputs.size() << " files" << std::endl;
+        if (weightColumn != std::string::npos && sumW > 0.)
+        {
+            std::cout << " -- sum of weights " << sumW << " +- " << std::sqrt(sumW2)
+                      << " (relative error " << std::sqrt(sumW2) / sumW << ")" << std::endl;
+            for (std::size_t i = 0; i < columnNames.size(); ++i)
+            {
+                if (i != weightColumn)
+                    std::cout << " -- weighted mean of " << columnNames[i] << ": " << sumWX[i] / sumW << std::endl;
+            }
+        }
+        return 0;
+    }
+    int MergeReceptors(std::ofstream &ofs, const std::vector<std::string> &inputs)
+    {
+        // columns: receptor, x, y, z, then the sums of fluence, fluence^2, air kerma, air kerma^2 over histories
+        std::vector<std::string> header;
+        std::string columns;
+        std::vector<std::vector<double>> sums;
+        double nHistories = 0.;
+        for (std::size_t i = 0; i < inputs.size(); ++i)
+        {
+            const auto &input = inputs[i];
+            std::ifstream ifs(input.c_str());
+            std::vector<std::string> fileHeader;
+            std::string line;
+            if (!ReadHeader(ifs, fileHeader, line))
+            {
+                std::cerr << "ERROR: Cannot read " << input << "." << std::endl;
+                return 1;
+            }
+            if (i == 0)
+            {
+                header = fileHeader;
+                columns = line;
+            }
+            else if (line != columns)
+            {
+                std::cerr << "ERROR: " << input << " does not have the columns of " << inputs[0] << "." << std::endl;
+                return 1;
+            }
+            nHistories += std::strtod(GetHeaderValue(fileHeader, "#histories").c_str(), nullptr);
+
+            std::size_t receptor = 0;
+            while (std::getline(ifs, line))
+            {
+                if (line.empty())
+                    continue;
+                auto row = ParseRow(line, ',');
+                if (row.size() != 8)
+                {
+                    std::cerr << "ERROR: " << input << " has a row with another number of columns than 8." << std::endl;
+                    return 1;
+                }
+                if (i == 0)
+                    sums.push_back(row);
+                else if (receptor >= sums.size() || !std::equal(row.begin(), row.begin() + 4, sums[receptor].begin()))
+                {
+                    std::cerr << "ERROR: " << input << " does not have the receptors of " << inputs[0] << "." << std::endl;
+                    return 1;
+                }
+                else
+                {
+                    for (std::size_t j = 4; j < row.size(); ++j)
+                        sums[receptor][j] += row[j];
+                }
+                ++receptor;
+            }
+            if (receptor != sums.size())
+            {
+                std::cerr << "ERROR: " << input << " does not have the receptors of " << inputs[0] << "." << std::endl;
+                return 1;
+            }
+        }
+
+        for (const auto &line : header)
+        {
+            if (line.compare(0, 11, "#histories ") == 0)
+                ofs << "#histories " << static_cast<unsigned long long>(nHistories) << "\n";
+            else
+                ofs << line << "\n";
+        }
+        ofs << columns << "\n";
+        for (const auto &row : sums)
+        {
+            for (std::size_t j = 0; j < row.size(); ++j)
+                ofs << (j > 0 ? "," : "") << row[j];
+            ofs << "\n";
+        }
+
+        std::cout << "Point receptors: " << sums.size() << " receptors, " << nHistories << " histories from "
+                  << inputs.size() << " files" << std::endl;
+        if (nHistories < 2.)
+            return 0;
+
+        // relative standard error of the mean over histories
+        auto relativeError = [nHistories](double sum, double sum2)
+        {
+            if (sum <= 0.)
+                return 0.;
+            auto mean = sum / nHistories;
+            return std::sqrt(std::max(sum2 / nHistories - mean * mean, 0.) / (nHistories - 1.)) / mean;
+        };
+        auto activity = std::strtod(GetHeaderValue(header, "#activity").c_str(), nullptr);
+        for (const auto &row : sums)
+        {
+            std::cout << " -- receptor " << row[0] << " at (" << row[1] << "," << row[2] << "," << row[3] << ") cm: fluence "
+                      << row[4] / nHistories << " /cm2 (" << 100. * relativeError(row[4], row[5]) << " %), air kerma "
+                      << row[6] / nHistories << " Gy (" << 100. * relativeError(row[6], row[7]) << " %) per history";
+            if (activity > 0.)
+                std::cout << ", air kerma rate " << row[6] / nHistories * activity * 3600. << " Gy/h";
+            std::cout << std::endl;
+        }
+        return 0;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    std::string outputName = argv[1];
+    std::vector<std::string> inputs(argv + 2, argv + argc);
+
+    std::string className;
+    for (const auto &input : inputs)
+    {
+        std::ifstream ifs(input.c_str());
+        std::string firstLine;
+        if (!ifs.is_open() || !std::getline(ifs, firstLine) || firstLine.compare(0, 7, "#class ") != 0)
+        {
+            std::cerr << "ERROR: " << input << " is not a Geant4 CSV histogram or ntuple, or a point receptor file." << std::endl;
+            return 1;
+        }
+        if (className.empty())
+            className = firstLine.substr(7);
+        else if (firstLine.substr(7) != className)
+        {
+            std::cerr << "ERROR: " << input << " is a " << firstLine.substr(7) << ", not a " << className << "." << std::endl;
+            return 1;
+        }
+    }
+
+    std::ofstream ofs(outputName.c_str(), std::ios::out | std::ios::trunc);
+    if (!ofs.is_open())
+    {
+        std::cerr << "ERROR: Cannot open " << outputName << "." << std::endl;
+        return 1;
+    }
+    ofs << std::setprecision(15);
+
+    if (className == "advpg::nee")
+        return MergeReceptors(ofs, inputs);
+    if (className.find("histo") != std::string::npos)
+        return MergeHistograms(ofs, inputs);
+    if (className.find("ntuple") != std::string::npos)
+        return MergeNtuples(ofs, inputs);
+
+    std::cerr << "ERROR: Unsupported class " << className << "." << std::endl;
+    return 1;
+}
@@ -0,0 +1,50 @@
+/// \file advpg_validate.cc
+/// \brief Checks the primary samplers of example_advpg statistically.
+///
+/// Usage: advpg_validate [n]
+///
+/// Draws n primaries (default 100000) per configuration from AdvancedParticleGun
+/// with a fixed seed and checks them without transport (see SamplerValidation).
+/// The line sampler is always checked on synthetic nuclides. Exits with 0 if all
+/// checks pass, 1 if any fails, and 77 if none fails but the ICRP 107 nuclide
+/// configurations were skipped because the data were not found in ../ICRP07DATA,
+/// so that CTest reports the test as skipped.
+
+#include "SamplerValidation.hh"
+
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+    void PrintUsage()
+    {
+        std::cerr << " Usage: " << std::endl
+                  << " advpg_validate [n]" << std::endl
+                  << "\tn is the number of samples per configuration (default 100000)." << std::endl;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    long nSamples = 100000;
+    if (argc > 2)
+    {
+        PrintUsage();
+        return 1;
+    }
+    if (argc == 2)
+    {
+        char *end = nullptr;
+        errno = 0;
+        nSamples = std::strtol(argv[1], &end, 10);
+        if (end == argv[1] || *end != '\0' || errno == ERANGE || nSamples < 1 || nSamples > 100000000)
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    return SamplerValidation::Run(static_cast<G4int>(nSamples));
+}